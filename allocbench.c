@@ -0,0 +1,67 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mmu.h"
+#include "memstat.h"
+
+// pages allocated and freed again by each round of a worker
+#define NPAGES 16
+#define ROUNDS 500
+#define MAXWORKERS 8
+
+// grow and shrink the heap ROUNDS times, every page goes through kalloc and kfree
+void worker(int id) {
+	for(int i = 0; i < ROUNDS; i++) {
+		if(sbrk(NPAGES * PGSIZE) == (char *)-1) {
+			printf(1, "allocbench: sbrk failed in worker %d\n", id);
+			exit();
+		}
+		sbrk(-NPAGES * PGSIZE);
+	}
+	exit();
+}
+
+// run `workers` processes at once, returns elapsed ticks
+int run(int workers) {
+	int start = uptime();
+	for(int i = 0; i < workers; i++) {
+		int pid = fork();
+		if(pid < 0) {
+			printf(1, "allocbench: fork failed\n");
+			return -1;
+		} else if(pid == 0) {
+			worker(i);
+		}
+	}
+	for(int i = 0; i < workers; i++) {
+		wait();
+	}
+	return uptime() - start;
+}
+
+int main(int argc, char *argv[]) {
+	// largest number of concurrent workers, defaults to NCPU
+	int maxWorkers = argc > 1 ? atoi(argv[1]) : MAXWORKERS;
+	struct memstat before, after;
+	if(maxWorkers < 1 || maxWorkers > MAXWORKERS) {
+		printf(1, "usage: allocbench [workers 1-%d]\n", MAXWORKERS);
+		exit();
+	}
+	printf(1, "alloc + free of %d pages, %d rounds per worker\n", NPAGES, ROUNDS);
+	for(int workers = 1; workers <= maxWorkers; workers *= 2) {
+		memstat(&before);
+		int ticks = run(workers);
+		if(ticks < 0) {
+			break;
+		}
+		memstat(&after);
+		// avoid dividing by zero on very fast runs
+		int pages = workers * ROUNDS * NPAGES;
+		printf(1, "\t- %d workers : %d pages/tick, kmem lock %d/%d contended, cache locks %d/%d contended, %d steals\n",
+			workers, pages / (ticks ? ticks : 1),
+			after.kmemcontended - before.kmemcontended, after.kmemacquires - before.kmemacquires,
+			after.cachecontended - before.cachecontended, after.cacheacquires - before.cacheacquires,
+			after.steals - before.steals);
+	}
+	exit();
+}
@@ -0,0 +1,56 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+#include "memlayout.h"
+
+#define BENCHKEY 9500
+#define ROUNDS 500
+// attachments already present before each measurement
+#define STEP 8
+
+// average cycles for one attach at the first free address + detach
+uint attachCycles(int shmid) {
+	uint start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		void *ptr = (void *)shmat(shmid, (void *)0, 0);
+		if((int)ptr < 0 || shmdt(ptr) < 0) {
+			return -1;
+		}
+	}
+	return (rdtsc() - start) / ROUNDS;
+}
+
+int main(int argc, char *argv[]) {
+	void *held[SHAREDREGIONS];
+	int nheld = 0;
+	int shmid = shmget(BENCHKEY, PGSIZE, 06 | IPC_CREAT);
+	if(shmid < 0) {
+		printf(1, "attachbench: shmget failed\n");
+		exit();
+	}
+	printf(1, "attachments, shmat + shmdt cycles/op\n");
+	for(;;) {
+		printf(1, "%d, %d\n", shmcount(), attachCycles(shmid));
+		// grow the attach map, leaving a slot free for the measurement
+		int target = nheld + STEP < SHAREDREGIONS - 1 ? nheld + STEP : SHAREDREGIONS - 1;
+		if(target == nheld) {
+			break;
+		}
+		for(; nheld < target; nheld++) {
+			held[nheld] = (void *)shmat(shmid, (void *)0, 0);
+			if((int)held[nheld] < 0) {
+				printf(1, "attachbench: shmat failed\n");
+				exit();
+			}
+		}
+	}
+	for(int i = 0; i < nheld; i++) {
+		shmdt(held[i]);
+	}
+	shmctl(shmid, IPC_RMID, (void *)0);
+	exit();
+}
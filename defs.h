@@ -1,7 +1,9 @@
 struct buf;
 struct context;
+struct faultstat;
 struct file;
 struct inode;
+struct memstat;
 struct pipe;
 struct proc;
 struct rtcdate;
@@ -9,6 +11,7 @@ struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct trapframe;
 
 // bio.c
 void            binit(void);
@@ -25,6 +28,11 @@ void            panic(char*) __attribute__((noreturn));
 // exec.c
 int             exec(char*, char**);
 
+// fault.c
+int             pagefault(struct trapframe*);
+char*           faultname(uint);
+void            faultstat(struct faultstat*);
+
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
@@ -65,9 +73,17 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_order(int);
+void            kfree_order(char*, int);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+void            kmemstat(struct memstat*);
+uint            kfreepages(void);
+void            kref(char*);
+int             krefcount(char*);
+int             kzero_refill(void);
+char*           kzalloc(void);
 
 // kbd.c
 void            kbdintr(void);
@@ -78,6 +94,7 @@ int             lapicid(void);
 extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
@@ -95,7 +112,11 @@ void            mpinit(void);
 void            picenable(int);
 void            picinit(void);
 
+// msg.c
+void            msginit(void);
+
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
@@ -119,11 +140,26 @@ void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
 void            wakeup(void*);
+int             wakeupn(void*, int);
+void            wakeproc(struct proc*, void*);
+void            procforeach(void (*)(struct proc*, void*), void*);
 void            yield(void);
 
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// sem.c
+void            seminit(void);
+
+// slab.c
+struct objcache;
+struct slabstat;
+void            slabinit(void);
+void            objcache_init(struct objcache*, char*, uint);
+void*           objalloc(struct objcache*);
+void            objfree(struct objcache*, void*);
+int             slabstat(struct slabstat*, int);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -184,13 +220,18 @@ pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
+int             cowPageFault(pde_t*, uint);
+int             lazyPageFault(pde_t*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
+void            tlbflush(pde_t*, uint, uint);
+void            tlbflushintr(void);
+void            tlbstat(struct memstat*);
 
 // Shared memory (vm.c)
 void sharedMemoryInit(void);
-int getShmidIndex(int);
-void mappagesWrapper(struct proc *process, int, int);
-void shmdtWrapper(void *);
+void shmFork(struct proc *parent, struct proc *child);
+void shmDetachAll(void);
+int shmPageFault(uint, uint);
 
 // number of elements in fixed-size array
 #define NELEM(x) (sizeof(x)/sizeof((x)[0]))
@@ -96,16 +96,13 @@ exec(char *path, char **argv)
   /*
     Detach shared region segments
   */
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    if(curproc->pages[i].shmid != -1 && curproc->pages[i].key != -1) {
-      shmdtWrapper(curproc->pages[i].virtualAddr);
-    }
-  }
+  shmDetachAll();
 
   // Commit to the user image.
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
+  curproc->stackbase = sz - PGSIZE;
   curproc->tf->eip = elf.entry;  // main
   curproc->tf->esp = sp;
   switchuvm(curproc);
@@ -0,0 +1,112 @@
+// Page fault dispatch.
+//
+// A fault is handed to the handler of the address range it falls in,
+// each range of a process (heap, stack, shared memory) has its own. The
+// number of faults served and the cycles spent on them are kept per
+// process and range, and reported by faultstat().
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+#include "fault.h"
+
+// text, data and heap: heap pages reserved by sbrk are allocated on
+// first touch, writes to pages shared copy-on-write by fork copy them
+static int
+heapfault(struct proc *p, uint va, uint err)
+{
+  if(!(err & FEC_PR))
+    return lazyPageFault(p->pgdir, va);
+  if(err & FEC_WR)
+    return cowPageFault(p->pgdir, va);
+  return -1;
+}
+
+// the stack is copy-on-write after fork like the heap, a fault on the
+// guard page below it is a stack overflow
+static int
+stackfault(struct proc *p, uint va, uint err)
+{
+  if(va < p->stackbase)
+    return -1;
+  return heapfault(p, va, err);
+}
+
+// lazy and huge shared memory pages and attachments grown by SHM_RESIZE
+static int
+shmfault(struct proc *p, uint va, uint err)
+{
+  return shmPageFault(va, err);
+}
+
+static struct {
+  char *name;
+  int (*handler)(struct proc*, uint, uint);
+} ranges[NFAULTKINDS] = {
+[FAULT_HEAP]  { "heap", heapfault },
+[FAULT_STACK] { "stack", stackfault },
+[FAULT_SHM]   { "shm", shmfault },
+[FAULT_NONE]  { "unmapped", 0 },
+};
+
+// range of p that va falls in
+static int
+faultrange(struct proc *p, uint va)
+{
+  if(va >= HEAPLIMIT && va < KERNBASE)
+    return FAULT_SHM;
+  // processes started without exec have no separate stack
+  if(p->stackbase && va >= p->stackbase - PGSIZE && va < p->stackbase + PGSIZE)
+    return FAULT_STACK;
+  if(va < p->sz)
+    return FAULT_HEAP;
+  return FAULT_NONE;
+}
+
+// Serves the page fault in tf for the current process, also one taken
+// by the kernel on a user address. Returns 0 if it was served, -1 if
+// the access is fatal.
+int
+pagefault(struct trapframe *tf)
+{
+  struct proc *p = myproc();
+  uint va = rcr2();
+  uint start = rdtsc();
+  int kind;
+
+  if(p == 0)
+    return -1;
+  kind = faultrange(p, va);
+  if(ranges[kind].handler == 0 || ranges[kind].handler(p, va, tf->err) < 0){
+    p->faultfatal++;
+    return -1;
+  }
+  p->faults[kind]++;
+  p->faultcycles[kind] += rdtsc() - start;
+  return 0;
+}
+
+// name of the range of the current process that va falls in, for messages
+char*
+faultname(uint va)
+{
+  return ranges[faultrange(myproc(), va)].name;
+}
+
+// copies the fault statistics of the current process to st
+void
+faultstat(struct faultstat *st)
+{
+  struct proc *p = myproc();
+
+  for(int i = 0; i < NFAULTKINDS; i++){
+    st->count[i] = p->faults[i];
+    st->cycles[i] = p->faultcycles[i];
+  }
+  st->fatal = p->faultfatal;
+}
@@ -0,0 +1,15 @@
+// Page fault ranges and statistics, see fault.c.
+
+// address ranges of a process, each with its own fault handler
+#define FAULT_HEAP 0  // text, data and heap below sz
+#define FAULT_STACK 1 // user stack and the guard page below it
+#define FAULT_SHM 2   // attached shared memory, HEAPLIMIT up to KERNBASE
+#define FAULT_NONE 3  // outside every range, always fatal
+#define NFAULTKINDS 4
+
+// faults of one process by range, filled by faultstat
+struct faultstat {
+  uint count[NFAULTKINDS];  // faults served
+  uint cycles[NFAULTKINDS]; // rdtsc cycles spent serving them
+  uint fatal;               // faults no handler could serve, children's added by wait
+};
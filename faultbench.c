@@ -0,0 +1,68 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+#include "fault.h"
+
+#define BENCHKEY 9700
+#define PAGES 256
+
+char *names[NFAULTKINDS] = {"heap", "stack", "shm", "none"};
+
+// touches PAGES pages at p and prints the faults they took in range kind,
+// the kernel's cycles per fault and the cycles per touch seen from user space
+void touch(char *test, char *p, int kind) {
+	struct faultstat before, after;
+	faultstat(&before);
+	uint start = rdtsc();
+	for(int i = 0; i < PAGES; i++) {
+		p[i*PGSIZE] = i;
+	}
+	uint cycles = rdtsc() - start;
+	faultstat(&after);
+	uint faults = after.count[kind] - before.count[kind];
+	uint kcycles = after.cycles[kind] - before.cycles[kind];
+	printf(1, "%s, %s, %d, %d, %d\n", test, names[kind], faults,
+		faults ? kcycles / faults : 0, cycles / PAGES);
+}
+
+int main(int argc, char *argv[]) {
+	struct faultstat st;
+	char *heap = sbrk(PAGES*PGSIZE);
+	if((int)heap == -1) {
+		printf(1, "faultbench: sbrk failed\n");
+		exit();
+	}
+	printf(1, "test, range, faults, kernel cycles/fault, cycles/touch\n");
+	// pages reserved by sbrk come in on first touch
+	touch("sbrk", heap, FAULT_HEAP);
+	// resident pages, no faults
+	touch("resident", heap, FAULT_HEAP);
+	// writes after fork copy the pages
+	if(fork() == 0) {
+		touch("cow", heap, FAULT_HEAP);
+		// already copied, writable again
+		touch("cow-again", heap, FAULT_HEAP);
+		exit();
+	}
+	wait();
+	int shmid = shmget(BENCHKEY, PAGES*PGSIZE, 06 | IPC_CREAT | SHM_LAZY);
+	char *shm = (char *)shmat(shmid, (void *)0, 0);
+	if(shmid < 0 || (int)shm == -1) {
+		printf(1, "faultbench: shm setup failed\n");
+		exit();
+	}
+	touch("shm-lazy", shm, FAULT_SHM);
+	shmdt(shm);
+	shmctl(shmid, IPC_RMID, (void *)0);
+	faultstat(&st);
+	printf(1, "totals:");
+	for(int i = 0; i < NFAULTKINDS - 1; i++) {
+		printf(1, " %s=%d", names[i], st.count[i]);
+	}
+	printf(1, " fatal=%d\n", st.fatal);
+	exit();
+}
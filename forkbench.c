@@ -0,0 +1,68 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+
+#define ROUNDS 10
+
+char *argvExit[] = { "forkbench", "-x", 0 };
+
+// fork a child per round running child(heap, size), average cycles until it is reaped
+uint forkCycles(void (*child)(char *, int), char *heap, int size) {
+	uint start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		int pid = fork();
+		if(pid < 0) {
+			printf(1, "forkbench: fork failed\n");
+			return -1;
+		} else if(pid == 0) {
+			child(heap, size);
+			exit();
+		}
+		wait();
+	}
+	return (rdtsc() - start) / ROUNDS;
+}
+
+// what a shell does: exec right away
+void execChild(char *heap, int size) {
+	exec(argvExit[0], argvExit);
+	printf(1, "forkbench: exec failed\n");
+}
+
+// write every page, so every page gets copied as an eager fork would
+void writeChild(char *heap, int size) {
+	for(int i = 0; i < size; i += PGSIZE) {
+		heap[i] = 1;
+	}
+}
+
+void exitChild(char *heap, int size) {
+}
+
+int main(int argc, char *argv[]) {
+	int sizes[] = {1024*1024, 16*1024*1024};
+	// exec target of execChild
+	if(argc > 1 && strcmp(argv[1], "-x") == 0) {
+		exit();
+	}
+	printf(1, "heap kb, fork+exit, fork+exec, fork+write all pages (cycles)\n");
+	for(int s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++) {
+		char *heap = sbrk(sizes[s]);
+		if(heap == (char *)-1) {
+			printf(1, "forkbench: sbrk failed\n");
+			exit();
+		}
+		// make the parent's pages resident and dirty
+		for(int i = 0; i < sizes[s]; i += PGSIZE) {
+			heap[i] = 1;
+		}
+		uint exitc = forkCycles(exitChild, heap, sizes[s]);
+		uint execc = forkCycles(execChild, heap, sizes[s]);
+		uint writec = forkCycles(writeChild, heap, sizes[s]);
+		printf(1, "%d, %d, %d, %d\n", sizes[s] / 1024, exitc, execc, writec);
+		sbrk(-sizes[s]);
+	}
+	exit();
+}
@@ -0,0 +1,86 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+
+#define BENCHKEY 9800
+#define FUTEXROUNDS 1000
+// polling costs at least a tick per hand-over, keep it short
+#define POLLROUNDS 20
+
+// ball[0] is the parent's turn counter, ball[1] the child's
+int *ball;
+
+// passes the ball back and forth `rounds` times, waiting with futexes
+void futexPlayer(int me, int rounds) {
+	int other = 1 - me;
+	for(int i = 1; i <= rounds; i++) {
+		if(me == 1) {
+			while(ball[other] < i) {
+				futex_wait(&ball[other], i - 1);
+			}
+		}
+		ball[me] = i;
+		futex_wake(&ball[me], 1);
+		if(me == 0) {
+			while(ball[other] < i) {
+				futex_wait(&ball[other], i - 1);
+			}
+		}
+	}
+}
+
+// same exchange, waiting with sleep(1) between checks
+void pollPlayer(int me, int rounds) {
+	int other = 1 - me;
+	for(int i = 1; i <= rounds; i++) {
+		if(me == 1) {
+			while(ball[other] < i) {
+				sleep(1);
+			}
+		}
+		ball[me] = i;
+		if(me == 0) {
+			while(ball[other] < i) {
+				sleep(1);
+			}
+		}
+	}
+}
+
+// runs one ping-pong between parent and a child
+void game(void (*player)(int, int), int rounds) {
+	ball[0] = ball[1] = 0;
+	int pid = fork();
+	if(pid < 0) {
+		printf(1, "futexbench: fork failed\n");
+		exit();
+	} else if(pid == 0) {
+		player(1, rounds);
+		exit();
+	}
+	player(0, rounds);
+	wait();
+}
+
+int main(int argc, char *argv[]) {
+	int shmid = shmget(BENCHKEY, PGSIZE, 06 | IPC_CREAT);
+	if(shmid < 0 || (int)(ball = (int *)shmat(shmid, (void *)0, 0)) < 0) {
+		printf(1, "futexbench: could not set up shared region\n");
+		exit();
+	}
+	printf(1, "ping-pong round trips between two processes:\n");
+	uint start = rdtsc();
+	game(futexPlayer, FUTEXROUNDS);
+	printf(1, "\t- futex_wait / futex_wake : %d cycles/round trip\n", (rdtsc() - start) / FUTEXROUNDS);
+	int ticks = uptime();
+	game(pollPlayer, POLLROUNDS);
+	ticks = uptime() - ticks;
+	printf(1, "\t- sleep(1) polling : %d ticks for %d round trips\n", ticks, POLLROUNDS);
+	shmdt(ball);
+	shmctl(shmid, IPC_RMID, (void *)0);
+	exit();
+}
@@ -0,0 +1,76 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+
+// segment swept by both runs, large enough to overflow the TLB with 4KB pages
+#define SEGSIZE (16*1024*1024 - PGSIZE)
+#define KEY4K 8100
+#define KEY4M 8200
+#define RANDOMACCESSES 200000
+
+static uint seed = 1;
+
+// small linear congruential generator, good enough to scatter accesses
+uint nextRandom(void) {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// cycles for one write + read pass over the whole segment
+uint sequential(int *ptr, int words) {
+	uint sum = 0, start = rdtsc();
+	for(int i = 0; i < words; i++) {
+		ptr[i] = i;
+	}
+	for(int i = 0; i < words; i++) {
+		sum += ptr[i];
+	}
+	// keep the reads from being optimized away
+	if(sum == 1) {
+		printf(1, " ");
+	}
+	return rdtsc() - start;
+}
+
+// cycles for RANDOMACCESSES read-modify-writes at random words
+uint random(int *ptr, int words) {
+	uint start = rdtsc();
+	for(int i = 0; i < RANDOMACCESSES; i++) {
+		ptr[nextRandom() % words] += 1;
+	}
+	return rdtsc() - start;
+}
+
+void run(char *name, uint key, int flag) {
+	int shmid = shmget(key, SEGSIZE, 06 | IPC_CREAT | flag);
+	if(shmid < 0) {
+		printf(1, "hugebench: shmget failed for %s pages\n", name);
+		return;
+	}
+	int *ptr = (int *)shmat(shmid, (void *)0, 0);
+	if((int)ptr < 0) {
+		printf(1, "hugebench: shmat failed for %s pages\n", name);
+		shmctl(shmid, IPC_RMID, (void *)0);
+		return;
+	}
+	int words = SEGSIZE / sizeof(int);
+	// first pass warms caches and page tables
+	sequential(ptr, words);
+	uint seq = sequential(ptr, words);
+	uint rnd = random(ptr, words);
+	printf(1, "%s pages:\n", name);
+	printf(1, "\t- sequential : %d cycles/KB\n", seq / (SEGSIZE / 1024));
+	printf(1, "\t- random : %d cycles/access\n", rnd / RANDOMACCESSES);
+	shmdt(ptr);
+	shmctl(shmid, IPC_RMID, (void *)0);
+}
+
+int main(int argc, char *argv[]) {
+	run("4KB", KEY4K, 0);
+	run("4MB", KEY4M, SHM_HUGETLB);
+	exit();
+}
@@ -1,9 +1,18 @@
-// flags for shmget
+// flags for shmget and msgget
 #define IPC_CREAT 01000
 #define IPC_EXCL 02000
 #define IPC_PRIVATE 0
 
-// flags for shmctl
+// flag for msgsnd and msgrcv, fail instead of blocking
+#define IPC_NOWAIT 04000
+
+// flags for shmctl and msgctl
 #define IPC_RMID 0
 #define IPC_SET 1
-#define IPC_STAT 2
\ No newline at end of file
+#define IPC_STAT 2
+
+struct ipc_perm {
+  uint __key; // key supplied to shmget / msgget
+  int mode; // READ - WRITE permissions. READ_SHM / RW_SHM, READ_MSG / RW_MSG
+  // mode = 0, while init, i.e. no permissions set
+};
@@ -0,0 +1,55 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "ipc.h"
+#include "shm.h"
+#include "msg.h"
+#include "sem.h"
+#include "memlayout.h"
+
+// lists every live shared memory region, message queue and semaphore set, like ipcs
+struct shminfo info[SHAREDREGIONS];
+struct msginfo queues[MSGMNI];
+struct seminfo sets[SEMMNI];
+
+int main(int argc, char *argv[]) {
+	int n = shminfo(info, SHAREDREGIONS);
+	if(n < 0) {
+		printf(2, "ipcs: shminfo failed\n");
+		exit();
+	}
+	printf(1, "------ Shared Memory Segments ------\n");
+	printf(1, "shmid\tkey\tbytes\tmode\tnattch\tcpid\tlpid\tstatus\trss\tattach\tdetach\tfault\n");
+	for(int i = 0; i < n; i++) {
+		printf(1, "%d\t%d\t%d\t%s\t%d\t%d\t%d\t%s\t%d\t%d\t%d\t%d\n",
+			info[i].shmid, info[i].key, info[i].size, info[i].mode == RW_SHM ? "rw" : "r",
+			info[i].nattch, info[i].cpid, info[i].lpid, info[i].toBeDeleted ? "dest" : "-",
+			info[i].rss, info[i].attaches, info[i].detaches, info[i].faults);
+	}
+	n = msginfo(queues, MSGMNI);
+	if(n < 0) {
+		printf(2, "ipcs: msginfo failed\n");
+		exit();
+	}
+	printf(1, "\n------ Message Queues ------\n");
+	printf(1, "msqid\tkey\tmode\tmsgs\tbytes\tlimit\tlspid\tlrpid\tsent\trecv\n");
+	for(int i = 0; i < n; i++) {
+		printf(1, "%d\t%d\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n",
+			queues[i].msqid, queues[i].key, queues[i].mode == RW_MSG ? "rw" : "r",
+			queues[i].qnum, queues[i].cbytes, queues[i].qbytes, queues[i].lspid, queues[i].lrpid,
+			queues[i].sent, queues[i].received);
+	}
+	n = seminfo(sets, SEMMNI);
+	if(n < 0) {
+		printf(2, "ipcs: seminfo failed\n");
+		exit();
+	}
+	printf(1, "\n------ Semaphore Arrays ------\n");
+	printf(1, "semid\tkey\tmode\tnsems\twaiting\tops\tsleeps\n");
+	for(int i = 0; i < n; i++) {
+		printf(1, "%d\t%d\t%s\t%d\t%d\t%d\t%d\n",
+			sets[i].semid, sets[i].key, sets[i].mode == RW_SEM ? "rw" : "r",
+			sets[i].nsems, sets[i].waiters, sets[i].ops, sets[i].sleeps);
+	}
+	exit();
+}
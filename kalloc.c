@@ -1,13 +1,26 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, and blocks of
+// 2^order physically contiguous pages with kalloc_order().
+//
+// Free memory is kept by a buddy allocator: a free block of
+// 2^order pages starts at a multiple of its size, and is merged
+// with its buddy (the other half of the block twice as large)
+// as soon as both are free.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "memstat.h"
+
+#define ZEROPOOLMAX 128  // pages kept zeroed ahead of time for kzalloc()
+#define ZEROBATCH 8      // pages kzero_refill() zeroes per tick at most
+#define KCACHEBATCH 16   // pages moved at once between a CPU cache and the freelists
+#define KCACHEMAX 64     // a CPU cache above this gives a batch back
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -15,14 +28,40 @@ extern char end[]; // first address after kernel loaded from ELF file
 
 struct run {
   struct run *next;
+  struct run *prev;  // only kept on the buddy lists
+};
+
+// Pages kept by one CPU, so that most kalloc() and kfree() calls
+// only take this lock, which other CPUs take just to steal pages.
+// Lock order: a kcache lock, then kmem.lock.
+struct kcache {
+  struct spinlock lock;
+  struct run *list;
+  uint n;
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct kcache cache[NCPU];
+  uint refills, drains;  // batches moved under kmem.lock
+  volatile uint steals;
+  struct run *freelist[KMAXORDER+1];  // free blocks of 2^order pages
+  uint nblocks[KMAXORDER+1];
+  uint freemap[PHYSTOP/PGSIZE/32];    // bit set = page starts a block on a freelist
+  uchar order[PHYSTOP/PGSIZE];        // order of the free block a page starts
+  uint nfree;                         // pages on the freelists
+  struct run *zerolist;  // zeroed pages, apart from the link in their first word
+  uint nzero;            // pages on zerolist or being zeroed for it
+  uint zerohits, zeromisses;
+  uchar refcnt[PHYSTOP/PGSIZE];  // mappings of each allocated page, > 1 for copy-on-write sharing
 } kmem;
 
+#define FREEBIT(v) (1 << ((V2P(v)/PGSIZE) % 32))
+#define FREEWORD(v) kmem.freemap[(V2P(v)/PGSIZE) / 32]
+#define REFCNT(v) kmem.refcnt[V2P(v)/PGSIZE]
+#define PFN(v) (V2P(v)/PGSIZE)
+
 // Initialization happens in two phases.
 // 1. main() calls kinit1() while still using entrypgdir to place just
 // the pages mapped by entrypgdir on free list.
@@ -31,7 +70,11 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cache[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -51,6 +94,155 @@ freerange(void *vstart, void *vend)
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
     kfree(p);
 }
+// Atomically add n to the mapping count of page v.
+// Returns the count before the addition.
+static uchar
+refadd(char *v, uchar n)
+{
+  volatile uchar *p = &REFCNT(v);
+
+  asm volatile("lock; xaddb %0, %1" : "+q" (n), "+m" (*p) : : "memory", "cc");
+  return n;
+}
+
+// Take the free block r of 2^order pages off its freelist.
+static void
+buddy_unlink(struct run *r, int order)
+{
+  if(r->prev)
+    r->prev->next = r->next;
+  else
+    kmem.freelist[order] = r->next;
+  if(r->next)
+    r->next->prev = r->prev;
+  kmem.nblocks[order]--;
+  FREEWORD(r) &= ~FREEBIT(r);
+}
+
+static void
+buddy_link(struct run *r, int order)
+{
+  r->prev = 0;
+  r->next = kmem.freelist[order];
+  if(r->next)
+    r->next->prev = r;
+  kmem.freelist[order] = r;
+  kmem.nblocks[order]++;
+  kmem.order[PFN(r)] = order;
+  FREEWORD(r) |= FREEBIT(r);
+}
+
+// Give the block of 2^order pages at r back, merging it with its
+// buddy for as long as that one is free too. Caller holds kmem.lock.
+static void
+buddy_free(struct run *r, int order)
+{
+  uint pfn, buddy;
+
+  kmem.nfree += 1 << order;
+  pfn = PFN(r);
+  for(; order < KMAXORDER; order++){
+    buddy = pfn ^ (1 << order);
+    if(buddy >= PHYSTOP/PGSIZE || !(kmem.freemap[buddy/32] & (1 << buddy%32)) ||
+       kmem.order[buddy] != order)
+      break;
+    buddy_unlink(P2V(buddy*PGSIZE), order);
+    pfn &= ~(1 << order);
+  }
+  buddy_link(P2V(pfn*PGSIZE), order);
+}
+
+// Take a block of 2^order pages, splitting the smallest larger
+// block if there is none. Caller holds kmem.lock.
+static struct run*
+buddy_alloc(int order)
+{
+  struct run *r;
+  int o;
+
+  for(o = order; o <= KMAXORDER && kmem.freelist[o] == 0; o++)
+    ;
+  if(o > KMAXORDER)
+    return 0;
+  r = kmem.freelist[o];
+  buddy_unlink(r, o);
+  // the upper halves of the split block stay free
+  while(o > order){
+    o--;
+    buddy_link((struct run*)((char*)r + (PGSIZE << o)), o);
+  }
+  kmem.nfree -= 1 << order;
+  return r;
+}
+
+// Lock and return the calling CPU's cache.
+static struct kcache*
+mycache(void)
+{
+  struct kcache *c;
+
+  pushcli();
+  c = &kmem.cache[cpuid()];
+  acquire(&c->lock);
+  popcli();
+  return c;
+}
+
+// Give up to n pages of the locked cache c back to the freelist.
+static void
+cache_drain(struct kcache *c, uint n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  for(; n > 0 && (r = c->list) != 0; n--){
+    c->list = r->next;
+    c->n--;
+    buddy_free(r, 0);
+  }
+  kmem.drains++;
+  release(&kmem.lock);
+}
+
+// Take half of the pages of another CPU's cache, the first one is
+// returned and the others are put in the cache of the caller, who
+// must not hold any kcache lock.
+static struct run*
+cache_steal(void)
+{
+  struct kcache *c, *victim;
+  struct run *r, *last;
+  uint i, n;
+
+  r = 0;
+  for(victim = kmem.cache; victim < &kmem.cache[NCPU]; victim++){
+    acquire(&victim->lock);
+    if((n = (victim->n + 1) / 2) > 0){
+      r = last = victim->list;
+      for(i = 1; i < n; i++)
+        last = last->next;
+      victim->list = last->next;
+      victim->n -= n;
+      last->next = 0;
+    }
+    release(&victim->lock);
+    if(r)
+      break;
+  }
+  if(r == 0)
+    return 0;
+  xaddl(&kmem.steals, 1);
+  c = mycache();
+  for(last = r->next; last; c->n++){
+    struct run *next = last->next;
+    last->next = c->list;
+    c->list = last;
+    last = next;
+  }
+  release(&c->lock);
+  return r;
+}
+
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -60,37 +252,280 @@ void
 kfree(char *v)
 {
   struct run *r;
+  struct kcache *c;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
+  // A page shared copy-on-write is only freed by its last user.
+  // Pages handed to freerange() have a count of 0.
+  if(REFCNT(v) != 0 && refadd(v, -1) > 1)
+    return;
+
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+  if(!kmem.use_lock){
+    // still booting on one CPU, straight to the freelists
+    buddy_free(r, 0);
+    return;
+  }
+  c = mycache();
+  r->next = c->list;
+  c->list = r;
+  c->n++;
+  if(c->n > KCACHEMAX)
+    cache_drain(c, KCACHEBATCH);
+  release(&c->lock);
 }
 
 // Allocate one 4096-byte page of physical memory.
+// Takes it from the calling CPU's cache, which is refilled in a
+// batch from the freelist when empty. Only when the freelist and
+// the zero pool are empty too are pages stolen from another CPU.
 // Returns a pointer that the kernel can use.
 // Returns 0 if the memory cannot be allocated.
 char*
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
+  uint n;
+
+  if(!kmem.use_lock){
+    r = buddy_alloc(0);
+    if(r)
+      REFCNT(r) = 1;
+    return (char*)r;
+  }
+  c = mycache();
+  if(c->list == 0){
+    acquire(&kmem.lock);
+    for(n = 0; n < KCACHEBATCH && (r = buddy_alloc(0)) != 0; n++){
+      r->next = c->list;
+      c->list = r;
+      c->n++;
+    }
+    if(n > 0)
+      kmem.refills++;
+    else if((r = kmem.zerolist) != 0){
+      // out of plain pages, the zero pool is free memory too
+      kmem.zerolist = r->next;
+      kmem.nzero--;
+      r->next = 0;
+      c->list = r;
+      c->n++;
+    }
+    release(&kmem.lock);
+  }
+  if((r = c->list) != 0){
+    c->list = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  if(r == 0 && (r = cache_steal()) == 0)
+    return 0;
+  REFCNT(r) = 1;
+  return (char*)r;
+}
+
+// Record one more mapping of the allocated page v, see kfree().
+void
+kref(char *v)
+{
+  uchar n;
+
+  if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
+    panic("kref");
+  n = refadd(v, 1);
+  if(n == 0 || n == 255)
+    panic("kref: count");
+}
+
+// Number of mappings of the allocated page v.
+int
+krefcount(char *v)
+{
+  return *(volatile uchar*)&REFCNT(v);
+}
+
+// Allocate one zeroed 4096-byte page of physical memory.
+// Takes a page zeroed ahead of time by an idle CPU if there
+// is one, see kzero_refill(), otherwise zeroes it here.
+// Returns 0 if the memory cannot be allocated.
+char*
+kzalloc(void)
+{
+  struct run *r;
+  char *v;
 
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  r = kmem.zerolist;
+  if(r){
+    kmem.zerolist = r->next;
+    kmem.nzero--;
+    kmem.zerohits++;
+    REFCNT(r) = 1;
+  } else
+    kmem.zeromisses++;
   if(kmem.use_lock)
     release(&kmem.lock);
+  if(r){
+    r->next = 0;
+    return (char*)r;
+  }
+  if((v = kalloc()) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+static uint zerotick;  // tick of the last kzero_refill() batch
+
+// Move up to ZEROBATCH free pages to the zero pool, zeroing them
+// without holding kmem.lock. Called by the scheduler on idle CPUs,
+// does nothing more than once a tick. Returns the number of pages
+// moved, 0 if the pool is full or there is no free page.
+int
+kzero_refill(void)
+{
+  struct run *r;
+  int n;
+
+  // unlocked peeks, the idle loop comes here on every pass
+  if(!kmem.use_lock || kmem.nzero >= ZEROPOOLMAX || zerotick == ticks)
+    return 0;
+  zerotick = ticks;
+  for(n = 0; n < ZEROBATCH; n++){
+    acquire(&kmem.lock);
+    if(kmem.nzero >= ZEROPOOLMAX || (r = buddy_alloc(0)) == 0){
+      release(&kmem.lock);
+      break;
+    }
+    // counted now, so that other idle CPUs stop at ZEROPOOLMAX
+    kmem.nzero++;
+    release(&kmem.lock);
+
+    memset(r, 0, PGSIZE);
+
+    acquire(&kmem.lock);
+    r->next = kmem.zerolist;
+    kmem.zerolist = r;
+    release(&kmem.lock);
+  }
+  return n;
+}
+
+// Pages that could be allocated now, in the freelists, the zero pool
+// and the per-CPU caches. Read without locks, for estimates only.
+uint
+kfreepages(void)
+{
+  uint n;
+  int i;
+
+  n = kmem.nfree + kmem.nzero;
+  for(i = 0; i < NCPU; i++)
+    n += kmem.cache[i].n;
+  return n;
+}
+
+// Copy the allocator's counters into st.
+void
+kmemstat(struct memstat *st)
+{
+  int i;
+
+  st->cachedpages = 0;
+  for(i = 0; i < NCPU; i++)
+    st->cachedpages += kmem.cache[i].n;
+  acquire(&kmem.lock);
+  st->freepages = kmem.nfree;
+  st->zeropages = kmem.nzero;
+  st->zerohits = kmem.zerohits;
+  st->zeromisses = kmem.zeromisses;
+  st->refills = kmem.refills;
+  st->drains = kmem.drains;
+  for(i = 0; i <= KMAXORDER; i++)
+    st->freeblocks[i] = kmem.nblocks[i];
+  st->steals = kmem.steals;
+  st->kmemacquires = kmem.lock.nacquire;
+  st->kmemcontended = kmem.lock.ncontended;
+  st->cacheacquires = st->cachecontended = 0;
+  for(i = 0; i < NCPU; i++){
+    st->cacheacquires += kmem.cache[i].lock.nacquire;
+    st->cachecontended += kmem.cache[i].lock.ncontended;
+  }
+  release(&kmem.lock);
+}
+
+// Return the pages of every CPU cache to the freelists, where
+// they can merge into larger blocks.
+static void
+kcache_flush(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++){
+    acquire(&kmem.cache[i].lock);
+    if(kmem.cache[i].n > 0)
+      cache_drain(&kmem.cache[i], kmem.cache[i].n);
+    release(&kmem.cache[i].lock);
+  }
+}
+
+// Allocate 2^order physically contiguous pages, starting at a
+// physical address that is a multiple of their size.
+// The pages can be given back all together with kfree_order(),
+// or one at a time with kfree().
+// Returns 0 if there is no such block.
+char*
+kalloc_order(int order)
+{
+  struct run *r;
+  int i;
+
+  if(order < 0 || order > KMAXORDER)
+    return 0;
+  if(order == 0)
+    return kalloc();
+  acquire(&kmem.lock);
+  r = buddy_alloc(order);
+  release(&kmem.lock);
+  if(r == 0){
+    // free pages held by the CPU caches may complete a block
+    kcache_flush();
+    acquire(&kmem.lock);
+    r = buddy_alloc(order);
+    release(&kmem.lock);
+  }
+  if(r == 0)
+    return 0;
+  for(i = 0; i < 1 << order; i++)
+    REFCNT((char*)r + i*PGSIZE) = 1;
   return (char*)r;
 }
 
+// Free the block of 2^order pages at v returned by kalloc_order().
+void
+kfree_order(char *v, int order)
+{
+  int i;
+
+  if(order < 0 || order > KMAXORDER || V2P(v) % (PGSIZE << order) ||
+     v < end || V2P(v) + (PGSIZE << order) > PHYSTOP)
+    panic("kfree_order");
+  for(i = 0; i < 1 << order; i++){
+    if(REFCNT(v + i*PGSIZE) != 1)
+      panic("kfree_order: shared");
+    REFCNT(v + i*PGSIZE) = 0;
+  }
+
+  // Fill with junk to catch dangling refs.
+  memset(v, 1, PGSIZE << order);
+
+  acquire(&kmem.lock);
+  buddy_free((struct run*)v, order);
+  release(&kmem.lock);
+}
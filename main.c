@@ -29,7 +29,9 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
+  slabinit();      // kernel object caches
   fileinit();      // file table
+  pipeinit();      // pipe cache
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
@@ -37,6 +39,10 @@ main(void)
   
   // Shared Memory init
   sharedMemoryInit();
+  // Message queues init
+  msginit();
+  // Semaphores init
+  seminit();
 
   mpmain();        // finish this processor's setup
 }
@@ -0,0 +1,144 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "fault.h"
+
+/*
+	malloc-heavy workloads. Each runs in a freshly exec'd process, so
+	every heap fault it takes is a page it touched for the first time.
+	Prints the pages sbrk reserved, the pages that became resident, the
+	cycles of the workload and the cycles its heap faults took, and the
+	cycles to touch the rest of the reservation, which an eager sbrk
+	would have spent on allocating and zeroing it.
+*/
+
+#define NODES 20000
+#define BUFFERS 32
+#define BUFSIZE (64*1024)
+#define BUFUSED 1024
+#define ROUNDS 4000
+#define WINDOW 64
+
+struct node {
+	struct node *next;
+	int value[4];
+};
+
+static uint seed = 1;
+
+uint nextRandom(void) {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// a long linked list, every byte allocated is used
+int list(void) {
+	struct node *head = 0;
+	for(int i = 0; i < NODES; i++) {
+		struct node *n = malloc(sizeof(*n));
+		if(n == 0) {
+			return -1;
+		}
+		n->value[0] = i;
+		n->next = head;
+		head = n;
+	}
+	int sum = 0;
+	for(struct node *n = head; n; n = n->next) {
+		sum += n->value[0];
+	}
+	return sum;
+}
+
+// large buffers of which only the start is used
+int buffers(void) {
+	char *buf[BUFFERS];
+	for(int i = 0; i < BUFFERS; i++) {
+		if((buf[i] = malloc(BUFSIZE)) == 0) {
+			return -1;
+		}
+		memset(buf[i], i, BUFUSED);
+	}
+	for(int i = 0; i < BUFFERS; i++) {
+		free(buf[i]);
+	}
+	return 0;
+}
+
+// blocks of random sizes allocated and freed, a window of them live at a time
+int churn(void) {
+	char *live[WINDOW];
+	memset(live, 0, sizeof(live));
+	for(int i = 0; i < ROUNDS; i++) {
+		int slot = i % WINDOW;
+		free(live[slot]);
+		int size = 16 + nextRandom() % 4096;
+		if((live[slot] = malloc(size)) == 0) {
+			return -1;
+		}
+		live[slot][0] = i;
+		live[slot][size - 1] = i;
+	}
+	for(int i = 0; i < WINDOW; i++) {
+		free(live[i]);
+	}
+	return 0;
+}
+
+struct workload {
+	char *name;
+	int (*run)(void);
+} workloads[] = {
+	{"list", list},
+	{"buffers", buffers},
+	{"churn", churn},
+};
+
+void measure(struct workload *w) {
+	struct faultstat before, after;
+	char *start = sbrk(0);
+	faultstat(&before);
+	uint t0 = rdtsc();
+	if(w->run() < 0) {
+		printf(1, "mallocbench: %s: out of memory\n", w->name);
+		return;
+	}
+	uint cycles = rdtsc() - t0;
+	faultstat(&after);
+	char *end = sbrk(0);
+	uint resident = after.count[FAULT_HEAP] - before.count[FAULT_HEAP];
+	uint faultcycles = after.cycles[FAULT_HEAP] - before.cycles[FAULT_HEAP];
+	// back the rest of the reservation, as an eager sbrk would have
+	t0 = rdtsc();
+	for(char *p = (char *)PGROUNDUP((uint)start); p < end; p += PGSIZE) {
+		*(volatile char *)p;
+	}
+	uint rest = rdtsc() - t0;
+	printf(1, "%s, %d, %d, %d, %d, %d\n", w->name, (PGROUNDUP((uint)end) - PGROUNDUP((uint)start)) / PGSIZE,
+		resident, cycles, faultcycles, rest);
+}
+
+int main(int argc, char *argv[]) {
+	int n = sizeof(workloads) / sizeof(workloads[0]);
+	if(argc == 2) {
+		for(int i = 0; i < n; i++) {
+			if(strcmp(argv[1], workloads[i].name) == 0) {
+				measure(&workloads[i]);
+			}
+		}
+		exit();
+	}
+	printf(1, "workload, reserved pages, resident pages, cycles, heap fault cycles, cycles to back the rest\n");
+	for(int i = 0; i < n; i++) {
+		char *args[] = {argv[0], workloads[i].name, 0};
+		if(fork() == 0) {
+			exec(argv[0], args);
+			printf(1, "mallocbench: exec failed\n");
+			exit();
+		}
+		wait();
+	}
+	exit();
+}
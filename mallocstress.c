@@ -0,0 +1,199 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+
+/*
+	Allocation stress, the size-class malloc of umalloc.c against the
+	first-fit allocator it replaced, copied below. Each run happens in
+	a child of its own, so both start from the same break. Prints the
+	operations per tick and per million cycles, and the peak heap the
+	allocator took from sbrk.
+*/
+
+#define SLOTS 1024
+#define OPS 100000
+#define PHASED 4000
+
+// Memory allocator by Kernighan and Ritchie,
+// The C programming Language, 2nd ed.  Section 8.7.
+
+typedef long Align;
+
+union header {
+	struct {
+		union header *ptr;
+		uint size;
+	} s;
+	Align x;
+};
+
+typedef union header Header;
+
+static Header base;
+static Header *freep;
+
+void krFree(void *ap) {
+	Header *bp, *p;
+
+	bp = (Header*)ap - 1;
+	for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
+		if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
+			break;
+	if(bp + bp->s.size == p->s.ptr) {
+		bp->s.size += p->s.ptr->s.size;
+		bp->s.ptr = p->s.ptr->s.ptr;
+	} else
+		bp->s.ptr = p->s.ptr;
+	if(p + p->s.size == bp) {
+		p->s.size += bp->s.size;
+		p->s.ptr = bp->s.ptr;
+	} else
+		p->s.ptr = bp;
+	freep = p;
+}
+
+static Header* krMorecore(uint nu) {
+	char *p;
+	Header *hp;
+
+	if(nu < 4096)
+		nu = 4096;
+	p = sbrk(nu * sizeof(Header));
+	if(p == (char*)-1)
+		return 0;
+	hp = (Header*)p;
+	hp->s.size = nu;
+	krFree((void*)(hp + 1));
+	return freep;
+}
+
+void* krMalloc(uint nbytes) {
+	Header *p, *prevp;
+	uint nunits;
+
+	nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
+	if((prevp = freep) == 0) {
+		base.s.ptr = freep = prevp = &base;
+		base.s.size = 0;
+	}
+	for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr) {
+		if(p->s.size >= nunits) {
+			if(p->s.size == nunits)
+				prevp->s.ptr = p->s.ptr;
+			else {
+				p->s.size -= nunits;
+				p += p->s.size;
+				p->s.size = nunits;
+			}
+			freep = prevp;
+			return (void*)(p + 1);
+		}
+		if(p == freep)
+			if((p = krMorecore(nunits)) == 0)
+				return 0;
+	}
+}
+
+struct allocator {
+	char *name;
+	void* (*alloc)(uint);
+	void (*release)(void*);
+} allocators[] = {
+	{"size-class", malloc, free},
+	{"first-fit", krMalloc, krFree},
+};
+
+char *slots[SLOTS];
+static uint seed = 1;
+static char *brk0, *peak;
+
+uint nextRandom(void) {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+// mostly small blocks, some medium ones and a few large ones
+uint randomSize(void) {
+	uint r = nextRandom() % 100;
+	if(r < 80) {
+		return 8 + nextRandom() % 120;
+	}
+	if(r < 97) {
+		return 128 + nextRandom() % 1920;
+	}
+	return 2048 + nextRandom() % 14336;
+}
+
+void* allocate(struct allocator *a, uint n) {
+	char *p = a->alloc(n);
+	if(p == 0) {
+		printf(1, "mallocstress: %s out of memory\n", a->name);
+		exit();
+	}
+	p[0] = p[n - 1] = 1;
+	if((char *)sbrk(0) > peak) {
+		peak = sbrk(0);
+	}
+	return p;
+}
+
+// random slots freed and refilled with random sizes
+int randomOps(struct allocator *a) {
+	for(int i = 0; i < OPS; i++) {
+		int s = nextRandom() % SLOTS;
+		if(slots[s]) {
+			a->release(slots[s]);
+			slots[s] = 0;
+		} else {
+			slots[s] = allocate(a, randomSize());
+		}
+	}
+	return OPS;
+}
+
+// many small blocks, every other one freed, then larger ones that do not fit the holes
+int phasedOps(struct allocator *a) {
+	char **blocks = allocate(a, PHASED * sizeof(char *));
+	int ops = 0;
+	for(; ops < OPS; ops += 3 * PHASED) {
+		for(int i = 0; i < PHASED; i++) {
+			blocks[i] = allocate(a, 24 + (i % 4) * 8);
+		}
+		for(int i = 0; i < PHASED; i += 2) {
+			a->release(blocks[i]);
+		}
+		for(int i = 0; i < PHASED; i += 2) {
+			blocks[i] = allocate(a, 96);
+		}
+		for(int i = 0; i < PHASED; i++) {
+			a->release(blocks[i]);
+		}
+	}
+	return ops;
+}
+
+// each workload returns the number of mallocs and frees it did
+void run(char *test, int (*workload)(struct allocator*), struct allocator *a) {
+	if(fork() == 0) {
+		brk0 = peak = sbrk(0);
+		int t0 = uptime();
+		uint c0 = rdtsc();
+		int ops = workload(a);
+		uint mcycles = (rdtsc() - c0) / 1000000;
+		int ticks = uptime() - t0;
+		printf(1, "%s, %s, %d, %d, %d\n", test, a->name, ops / (ticks > 0 ? ticks : 1),
+			ops / (mcycles > 0 ? mcycles : 1), (peak - brk0) / 1024);
+		exit();
+	}
+	wait();
+}
+
+int main(int argc, char *argv[]) {
+	printf(1, "workload, allocator, ops/tick, ops/Mcycle, peak sbrk KB\n");
+	for(int i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++) {
+		run("random", randomOps, &allocators[i]);
+		run("phased", phasedOps, &allocators[i]);
+	}
+	exit();
+}
@@ -9,8 +9,9 @@
 #define KERNLINK (KERNBASE+EXTMEM)  // Address where kernel is linked
 
 // Shared memory macros
-#define HEAPLIMIT 0x7F000000 // 16MB from this limit -> KERNBASE
+#define HEAPLIMIT 0x70000000 // 256MB from this limit -> KERNBASE
 #define SHAREDREGIONS 64    // maximum shared regions allowed
+#define SHMMAXPAGES 16384   // maximum pages in one shared region (64MB)
 
 #define V2P(a) (((uint) (a)) - KERNBASE)
 #define P2V(a) ((void *)(((char *) (a)) + KERNBASE))
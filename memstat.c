@@ -0,0 +1,55 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mmu.h"
+#include "memstat.h"
+
+#define NCACHES 16
+
+// prints the kernel's physical memory and object cache statistics
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  struct slabstat caches[NCACHES];
+  uint big, overhead;
+  int i, n;
+
+  if(memstat(&st) < 0){
+    printf(2, "memstat: failed\n");
+    exit();
+  }
+  printf(1, "free pages\t%d\n", st.freepages);
+  printf(1, "free blocks\t");
+  for(i = 0; i <= KMAXORDER; i++)
+    printf(1, " %d", st.freeblocks[i]);
+  printf(1, "  (by order 0..%d)\n", KMAXORDER);
+  // share of free memory not in blocks of the largest order,
+  // 0 when a 4MB block could take all of it
+  big = st.freeblocks[KMAXORDER] << KMAXORDER;
+  if(st.freepages > 0)
+    printf(1, "fragmentation\t%d%%\n", (st.freepages - big) * 100 / st.freepages);
+  printf(1, "zeroed pages\t%d\n", st.zeropages);
+  printf(1, "zero pool hits\t%d\n", st.zerohits);
+  printf(1, "zero pool misses\t%d\n", st.zeromisses);
+  printf(1, "cached pages\t%d\n", st.cachedpages);
+  printf(1, "cache refills\t%d\n", st.refills);
+  printf(1, "cache drains\t%d\n", st.drains);
+  printf(1, "cache steals\t%d\n", st.steals);
+  printf(1, "kmem lock\t%d acquired, %d contended\n", st.kmemacquires, st.kmemcontended);
+  printf(1, "cache locks\t%d acquired, %d contended\n", st.cacheacquires, st.cachecontended);
+  printf(1, "tlb local flushes\t%d\n", st.tlblocal);
+  printf(1, "tlb shootdown ipis\t%d\n", st.tlbipis);
+  printf(1, "tlb remote flushes\t%d\n", st.tlbremote);
+
+  n = slabstat(caches, NCACHES);
+  if(n > 0)
+    printf(1, "\ncache\tsize\tslabs\tinuse\tcached\toverhead\n");
+  for(i = 0; i < n; i++){
+    // bytes of the slab pages not holding allocated objects
+    overhead = caches[i].slabs * PGSIZE - caches[i].inuse * caches[i].objsize;
+    printf(1, "%s\t%d\t%d\t%d\t%d\t%d\n", caches[i].name, caches[i].objsize,
+           caches[i].slabs, caches[i].inuse, caches[i].cached, overhead);
+  }
+  exit();
+}
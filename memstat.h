@@ -0,0 +1,31 @@
+#define KMAXORDER 10  // largest block of kalloc_order(), 2^KMAXORDER pages
+
+// physical memory statistics, filled by the memstat system call
+struct memstat {
+  uint freepages;   // pages on the free lists
+  uint freeblocks[KMAXORDER+1];  // free blocks of 2^i pages
+  uint zeropages;   // pre-zeroed pages kept for kzalloc()
+  uint zerohits;    // kzalloc() calls served from the zero pool
+  uint zeromisses;  // kzalloc() calls that had to zero the page themselves
+  uint cachedpages; // free pages held in the per-CPU caches
+  uint refills;     // batches moved from the freelist to a CPU cache
+  uint drains;      // batches moved from a CPU cache to the freelist
+  uint steals;      // times a CPU took pages from another CPU's cache
+  uint kmemacquires;    // acquisitions of the global allocator lock
+  uint kmemcontended;   // of those, how many had to wait
+  uint cacheacquires;   // acquisitions of the per-CPU cache locks
+  uint cachecontended;  // of those, how many had to wait
+  uint tlblocal;    // TLB ranges invalidated by the CPU that unmapped them
+  uint tlbipis;     // TLB shootdown interrupts sent to other CPUs
+  uint tlbremote;   // TLB ranges invalidated on behalf of another CPU
+};
+
+// counters of one kernel object cache, filled by the slabstat system call
+struct slabstat {
+  char name[16];
+  uint objsize;     // bytes per object
+  uint perslab;     // objects per slab page
+  uint slabs;       // pages held by the cache
+  uint inuse;       // objects allocated
+  uint cached;      // free objects kept in the per-CPU magazines
+};
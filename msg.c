@@ -0,0 +1,351 @@
+// System V message queues.
+//
+// Queues use the same keys and flags as the shared memory regions in
+// vm.c: IPC_PRIVATE always makes a new queue, IPC_CREAT / IPC_EXCL
+// decide what happens for a key that exists, and the mode is READ_MSG
+// or RW_MSG. Messages are copied into objects of slab caches sized for
+// short control messages, and out again by msgrcv.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "slab.h"
+#include "ipc.h"
+#include "msg.h"
+
+// a queued message, its text follows the header
+struct msg {
+  struct msg *next;
+  int type;
+  uint size;
+};
+
+// largest text of each message cache, the last one holds MSGMAX
+static uint msgclass[] = {64 - sizeof(struct msg), 128 - sizeof(struct msg), MSGMAX};
+static char *msgclassname[] = {"msg64", "msg128", "msgmax"};
+static struct objcache msgcache[NELEM(msgclass)];
+
+struct msqueue {
+  // lock for the messages and counters of the queue. Receivers sleep
+  // on buffer.msg_qnum, senders on buffer.msg_cbytes
+  struct spinlock lock;
+  uint key;
+  int msqid; // index in msgTable, -1 while unused
+  uint gen; // bumped on IPC_RMID, so that sleepers notice their queue is gone
+  struct msg *head;
+  struct msg **tail; // next field of the last message, or &head
+  uint sent, received; // counted since the queue was created, reported by msginfo()
+  struct msqid_ds buffer;
+};
+
+struct {
+  // lock for creating and removing queues, taken before a queue's lock
+  struct spinlock lock;
+  struct msqueue queues[MSGMNI];
+} msgTable;
+
+// cache for a message with size bytes of text
+static struct objcache*
+msgCacheFor(uint size) {
+  int i = 0;
+  while(msgclass[i] < size) {
+    i++;
+  }
+  return &msgcache[i];
+}
+
+void
+msginit(void) {
+  initlock(&msgTable.lock, "Message queues");
+  for(int i = 0; i < NELEM(msgclass); i++) {
+    objcache_init(&msgcache[i], msgclassname[i], sizeof(struct msg) + msgclass[i]);
+  }
+  for(int i = 0; i < MSGMNI; i++) {
+    initlock(&msgTable.queues[i].lock, "Message queue");
+    msgTable.queues[i].msqid = -1;
+  }
+}
+
+// returns the id of the queue for key, creating it as msgflag says
+int
+msgget(uint key, int msgflag) {
+  int mode = msgflag & 7;
+  struct msqueue *q;
+
+  msgflag &= ~7;
+  // only looking up an existing key may leave out the mode
+  if(mode != READ_MSG && mode != RW_MSG && (mode != 0 || msgflag != 0 || key == IPC_PRIVATE)) {
+    return -1;
+  }
+  if(key == -1) {
+    return -1;
+  }
+  acquire(&msgTable.lock);
+  if(key != IPC_PRIVATE) {
+    for(q = msgTable.queues; q < &msgTable.queues[MSGMNI]; q++) {
+      if(q->msqid != -1 && q->key == key) {
+        int msqid = msgflag == (IPC_CREAT | IPC_EXCL) ? -1 : q->msqid;
+        release(&msgTable.lock);
+        return msqid;
+      }
+    }
+    if(!(msgflag & IPC_CREAT)) {
+      release(&msgTable.lock);
+      return -1;
+    }
+  }
+  for(q = msgTable.queues; q < &msgTable.queues[MSGMNI]; q++) {
+    if(q->msqid == -1) {
+      break;
+    }
+  }
+  if(q == &msgTable.queues[MSGMNI]) {
+    release(&msgTable.lock);
+    return -1;
+  }
+  acquire(&q->lock);
+  q->key = key;
+  q->head = 0;
+  q->tail = &q->head;
+  q->sent = q->received = 0;
+  memset(&q->buffer, 0, sizeof(q->buffer));
+  q->buffer.msg_perm.__key = key;
+  q->buffer.msg_perm.mode = mode;
+  q->buffer.msg_qbytes = MSGMNB;
+  q->msqid = q - msgTable.queues;
+  release(&q->lock);
+  release(&msgTable.lock);
+  return q->msqid;
+}
+
+// Queues msgsz bytes of text of the user's message. Blocks while the
+// queue is full, unless IPC_NOWAIT is set.
+// Returns 0, or -1 if the queue is read-only, full, or was removed
+int
+msgsnd(int msqid, struct msgbuf *umsg, uint msgsz, int msgflag) {
+  struct objcache *cache;
+  struct msqueue *q;
+  struct msg *m;
+  uint gen;
+
+  if(msqid < 0 || msqid >= MSGMNI || msgsz > MSGMAX || umsg->mtype <= 0) {
+    return -1;
+  }
+  // copy the message in before taking the lock
+  cache = msgCacheFor(msgsz);
+  if((m = objalloc(cache)) == 0) {
+    return -1;
+  }
+  m->next = 0;
+  m->type = umsg->mtype;
+  m->size = msgsz;
+  memmove(m + 1, umsg->mtext, msgsz);
+
+  q = &msgTable.queues[msqid];
+  acquire(&q->lock);
+  gen = q->gen;
+  if(q->msqid == -1 || q->buffer.msg_perm.mode != RW_MSG) {
+    goto bad;
+  }
+  while(q->buffer.msg_cbytes + msgsz > q->buffer.msg_qbytes) {
+    // would never fit, checked again after each sleep as IPC_SET may lower the limit
+    if(msgsz > q->buffer.msg_qbytes || (msgflag & IPC_NOWAIT) || myproc()->killed) {
+      goto bad;
+    }
+    sleep(&q->buffer.msg_cbytes, &q->lock);
+    if(q->gen != gen) {
+      goto bad;
+    }
+  }
+  *q->tail = m;
+  q->tail = &m->next;
+  q->buffer.msg_qnum += 1;
+  q->buffer.msg_cbytes += msgsz;
+  q->buffer.msg_lspid = myproc()->pid;
+  q->sent += 1;
+  wakeup(&q->buffer.msg_qnum);
+  release(&q->lock);
+  return 0;
+
+bad:
+  release(&q->lock);
+  objfree(cache, m);
+  return -1;
+}
+
+/*
+  Takes a message off the queue and copies its type and at most msgsz
+  bytes of text to the user's buffer. msgtyp 0 takes the first message,
+  a positive msgtyp the first message of that type, and a negative one
+  the first message of the lowest type up to -msgtyp. Blocks until there
+  is such a message, unless IPC_NOWAIT is set. A longer message fails
+  and stays queued, unless MSG_NOERROR is set.
+  Returns the number of text bytes copied, or -1
+*/
+int
+msgrcv(int msqid, struct msgbuf *umsg, uint msgsz, int msgtyp, int msgflag) {
+  struct msqueue *q;
+  struct msg **link, **p, *m;
+  uint gen;
+  int n;
+
+  if(msqid < 0 || msqid >= MSGMNI) {
+    return -1;
+  }
+  q = &msgTable.queues[msqid];
+  acquire(&q->lock);
+  gen = q->gen;
+  if(q->msqid == -1) {
+    release(&q->lock);
+    return -1;
+  }
+  for(;;) {
+    link = 0;
+    for(p = &q->head; *p; p = &(*p)->next) {
+      if(msgtyp == 0 || (*p)->type == msgtyp) {
+        link = p;
+        break;
+      }
+      if(msgtyp < 0 && (*p)->type <= -msgtyp && (link == 0 || (*p)->type < (*link)->type)) {
+        link = p;
+      }
+    }
+    if(link) {
+      break;
+    }
+    if((msgflag & IPC_NOWAIT) || myproc()->killed) {
+      release(&q->lock);
+      return -1;
+    }
+    sleep(&q->buffer.msg_qnum, &q->lock);
+    if(q->gen != gen) {
+      release(&q->lock);
+      return -1;
+    }
+  }
+  m = *link;
+  if(m->size > msgsz && !(msgflag & MSG_NOERROR)) {
+    release(&q->lock);
+    return -1;
+  }
+  *link = m->next;
+  if(q->tail == &m->next) {
+    q->tail = link;
+  }
+  q->buffer.msg_qnum -= 1;
+  q->buffer.msg_cbytes -= m->size;
+  q->buffer.msg_lrpid = myproc()->pid;
+  q->received += 1;
+  wakeup(&q->buffer.msg_cbytes);
+  release(&q->lock);
+
+  n = m->size < msgsz ? m->size : msgsz;
+  if(copyout(myproc()->pgdir, (uint)&umsg->mtype, &m->type, sizeof(m->type)) < 0 ||
+     copyout(myproc()->pgdir, (uint)umsg->mtext, m + 1, n) < 0) {
+    n = -1;
+  }
+  objfree(msgCacheFor(m->size), m);
+  return n;
+}
+
+// IPC_STAT, IPC_SET (mode and msg_qbytes) and IPC_RMID for a queue.
+// Removal wakes every process blocked on the queue, which then fails
+int
+msgctl(int msqid, int cmd, struct msqid_ds *buf) {
+  struct msqueue *q;
+  struct msqid_ds ds;
+  struct msg *m;
+
+  if(msqid < 0 || msqid >= MSGMNI) {
+    return -1;
+  }
+  q = &msgTable.queues[msqid];
+  switch(cmd) {
+    case IPC_STAT:
+      acquire(&q->lock);
+      if(q->msqid == -1) {
+        release(&q->lock);
+        return -1;
+      }
+      ds = q->buffer;
+      release(&q->lock);
+      return copyout(myproc()->pgdir, (uint)buf, &ds, sizeof(ds));
+    case IPC_SET:
+      ds = *buf;
+      if((ds.msg_perm.mode != READ_MSG && ds.msg_perm.mode != RW_MSG) || ds.msg_qbytes == 0) {
+        return -1;
+      }
+      acquire(&q->lock);
+      if(q->msqid == -1) {
+        release(&q->lock);
+        return -1;
+      }
+      q->buffer.msg_perm.mode = ds.msg_perm.mode;
+      q->buffer.msg_qbytes = ds.msg_qbytes;
+      // a larger limit may let blocked senders in
+      wakeup(&q->buffer.msg_cbytes);
+      release(&q->lock);
+      return 0;
+    case IPC_RMID:
+      acquire(&msgTable.lock);
+      acquire(&q->lock);
+      if(q->msqid == -1) {
+        release(&q->lock);
+        release(&msgTable.lock);
+        return -1;
+      }
+      m = q->head;
+      q->head = 0;
+      q->tail = &q->head;
+      q->msqid = -1;
+      q->gen += 1;
+      memset(&q->buffer, 0, sizeof(q->buffer));
+      wakeup(&q->buffer.msg_qnum);
+      wakeup(&q->buffer.msg_cbytes);
+      release(&q->lock);
+      release(&msgTable.lock);
+      while(m) {
+        struct msg *next = m->next;
+        objfree(msgCacheFor(m->size), m);
+        m = next;
+      }
+      return 0;
+    default:
+      return -1;
+  }
+}
+
+// copies the state of at most n live queues to the user array info,
+// returns the number of queues copied or -1 if info is not writable
+int
+msginfo(struct msginfo *info, int n) {
+  struct msginfo entry;
+  int count = 0;
+  for(int i = 0; i < MSGMNI && count < n; i++) {
+    struct msqueue *q = &msgTable.queues[i];
+    acquire(&q->lock);
+    if(q->msqid == -1) {
+      release(&q->lock);
+      continue;
+    }
+    entry.msqid = q->msqid;
+    entry.key = q->key;
+    entry.mode = q->buffer.msg_perm.mode;
+    entry.qnum = q->buffer.msg_qnum;
+    entry.cbytes = q->buffer.msg_cbytes;
+    entry.qbytes = q->buffer.msg_qbytes;
+    entry.lspid = q->buffer.msg_lspid;
+    entry.lrpid = q->buffer.msg_lrpid;
+    entry.sent = q->sent;
+    entry.received = q->received;
+    release(&q->lock);
+    if(copyout(myproc()->pgdir, (uint)&info[count], &entry, sizeof(entry)) < 0) {
+      return -1;
+    }
+    count++;
+  }
+  return count;
+}
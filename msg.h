@@ -0,0 +1,37 @@
+// System V message queues, see msg.c. Include ipc.h first.
+
+#define MSGMNI 16   // message queues in the system
+#define MSGMAX 256  // largest message text, in bytes
+#define MSGMNB 4096 // default limit of text bytes queued on one queue
+
+// flag for msgrcv, truncate a message longer than the buffer instead of failing
+#define MSG_NOERROR 010000
+
+// read, write
+#define READ_MSG 04
+#define RW_MSG 06
+
+// layout of the buffer passed to msgsnd / msgrcv, mtext is msgsz bytes long
+struct msgbuf {
+  int mtype; // positive message type
+  char mtext[1];
+};
+
+struct msqid_ds {
+  struct ipc_perm msg_perm;
+  uint msg_qnum; // messages on the queue
+  uint msg_cbytes; // text bytes on the queue
+  uint msg_qbytes; // limit of msg_cbytes, msgsnd blocks above it
+  int msg_lspid; // last msgsnd
+  int msg_lrpid; // last msgrcv
+};
+
+// state of one live queue, filled by msginfo
+struct msginfo {
+  int msqid;
+  uint key;
+  int mode; // READ_MSG / RW_MSG
+  uint qnum, cbytes, qbytes;
+  int lspid, lrpid;
+  uint sent, received; // counted since creation
+};
@@ -0,0 +1,147 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "ipc.h"
+#include "msg.h"
+
+#define ROUNDS 500
+#define MSGS 2000
+#define TYPEPING 1
+#define TYPEPONG 2
+
+struct {
+	int mtype;
+	char mtext[MSGMAX];
+} msg;
+
+char buf[MSGMAX];
+
+// fills buf with size bytes from fd, a pipe has no message boundaries
+void readAll(int fd, char *buf, int size) {
+	for(int got = 0; got < size; ) {
+		int n = read(fd, buf + got, size - got);
+		if(n <= 0) {
+			break;
+		}
+		got += n;
+	}
+}
+
+// average cycles for a ping to a child and its pong back, both on one queue told apart by type
+uint msgRoundTrip(int size) {
+	int msqid = msgget(IPC_PRIVATE, RW_MSG);
+	if(msqid < 0) {
+		return -1;
+	}
+	int pid = fork();
+	if(pid == 0) {
+		for(int i = 0; i < ROUNDS; i++) {
+			msgrcv(msqid, &msg, size, TYPEPING, 0);
+			msg.mtype = TYPEPONG;
+			msgsnd(msqid, &msg, size, 0);
+		}
+		exit();
+	}
+	uint start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		msg.mtype = TYPEPING;
+		msgsnd(msqid, &msg, size, 0);
+		msgrcv(msqid, &msg, size, TYPEPONG, 0);
+	}
+	uint cycles = (rdtsc() - start) / ROUNDS;
+	wait();
+	msgctl(msqid, IPC_RMID, 0);
+	return cycles;
+}
+
+// average cycles for a ping to a child and its pong back over two pipes
+uint pipeRoundTrip(int size) {
+	int ping[2], pong[2];
+	if(pipe(ping) < 0 || pipe(pong) < 0) {
+		return -1;
+	}
+	int pid = fork();
+	if(pid == 0) {
+		for(int i = 0; i < ROUNDS; i++) {
+			readAll(ping[0], buf, size);
+			write(pong[1], buf, size);
+		}
+		exit();
+	}
+	uint start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		write(ping[1], buf, size);
+		readAll(pong[0], buf, size);
+	}
+	uint cycles = (rdtsc() - start) / ROUNDS;
+	wait();
+	close(ping[0]);
+	close(ping[1]);
+	close(pong[0]);
+	close(pong[1]);
+	return cycles;
+}
+
+// messages per tick of size bytes from a child to its parent through a queue
+int msgThroughput(int size) {
+	int msqid = msgget(IPC_PRIVATE, RW_MSG);
+	if(msqid < 0) {
+		return -1;
+	}
+	int start = uptime();
+	int pid = fork();
+	if(pid == 0) {
+		msg.mtype = TYPEPING;
+		for(int i = 0; i < MSGS; i++) {
+			msgsnd(msqid, &msg, size, 0);
+		}
+		exit();
+	}
+	for(int i = 0; i < MSGS; i++) {
+		msgrcv(msqid, &msg, size, 0, 0);
+	}
+	int ticks = uptime() - start;
+	wait();
+	msgctl(msqid, IPC_RMID, 0);
+	return MSGS / (ticks > 0 ? ticks : 1);
+}
+
+// messages per tick of size bytes from a child to its parent through a pipe
+int pipeThroughput(int size) {
+	int fds[2];
+	if(pipe(fds) < 0) {
+		return -1;
+	}
+	int start = uptime();
+	int pid = fork();
+	if(pid == 0) {
+		close(fds[0]);
+		for(int i = 0; i < MSGS; i++) {
+			write(fds[1], buf, size);
+		}
+		exit();
+	}
+	close(fds[1]);
+	for(int i = 0; i < MSGS; i++) {
+		readAll(fds[0], buf, size);
+	}
+	int ticks = uptime() - start;
+	wait();
+	close(fds[0]);
+	return MSGS / (ticks > 0 ? ticks : 1);
+}
+
+int main(int argc, char *argv[]) {
+	printf(1, "round trip cycles, %d pings to a child and back\n", ROUNDS);
+	printf(1, "size, msg, pipe\n");
+	for(int size = 8; size <= MSGMAX; size *= 2) {
+		printf(1, "%d, %d, %d\n", size, msgRoundTrip(size), pipeRoundTrip(size));
+	}
+	printf(1, "messages/tick, %d messages from a child to its parent\n", MSGS);
+	printf(1, "size, msg, pipe\n");
+	for(int size = 8; size <= MSGMAX; size *= 2) {
+		printf(1, "%d, %d, %d\n", size, msgThroughput(size), pipeThroughput(size));
+	}
+	exit();
+}
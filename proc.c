@@ -121,6 +121,12 @@ found:
     p->pages[i].perm = PTE_W | PTE_U;
     p->pages[i].virtualAddr = (void *)0;
   }
+  p->nattached = 0;
+
+  p->stackbase = 0;
+  memset(p->faults, 0, sizeof(p->faults));
+  memset(p->faultcycles, 0, sizeof(p->faultcycles));
+  p->faultfatal = 0;
 
   return p;
 }
@@ -164,6 +170,10 @@ userinit(void)
 }
 
 // Grow current process's memory by n bytes.
+// Growth only reserves the addresses, each page is allocated on its
+// first touch (see heapfault in fault.c). A reservation that free
+// memory could not back right now is refused, so that malloc fails
+// rather than the process being killed on a later fault.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -173,8 +183,11 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    if(sz + n < sz || sz + n >= HEAPLIMIT)
+      return -1;
+    if((PGROUNDUP(sz + n) - PGROUNDUP(sz)) / PGSIZE > kfreepages())
       return -1;
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -207,6 +220,7 @@ fork(void)
     return -1;
   }
   np->sz = curproc->sz;
+  np->stackbase = curproc->stackbase;
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -222,18 +236,8 @@ fork(void)
 
   pid = np->pid;
 
-  // copy shared pages values from parent to child
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    if(curproc->pages[i].key != -1 && curproc->pages[i].shmid != -1) {
-      np->pages[i] = curproc->pages[i];
-      // get valid shmid index in shmtable-allRegions struct
-      int index = getShmidIndex(np->pages[i].shmid);
-      if(index != -1) {
-        // map them to child's address space
-        mappagesWrapper(np, index, i);
-      }
-    }
-  }
+  // inherit the shared regions attached by the parent
+  shmFork(curproc, np);
 
   acquire(&ptable.lock);
 
@@ -266,12 +270,7 @@ exit(void)
   }
 
   // detach, attached shared regions
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    if(curproc->pages[i].shmid != -1 && curproc->pages[i].key != -1) {
-      // wrapper that calls detach
-      shmdtWrapper(curproc->pages[i].virtualAddr);
-    }
-  }
+  shmDetachAll();
 
   begin_op();
   iput(curproc->cwd);
@@ -318,6 +317,8 @@ wait(void)
       if(p->state == ZOMBIE){
         // Found one.
         pid = p->pid;
+        // so the parent can tell that a child died of a fault
+        curproc->faultfatal += p->faultfatal;
         kfree(p->kstack);
         p->kstack = 0;
         freevm(p->pgdir);
@@ -355,6 +356,7 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
+  int ran;
   c->proc = 0;
   
   for(;;){
@@ -362,6 +364,7 @@ scheduler(void)
     sti();
 
     // Loop over process table looking for process to run.
+    ran = 0;
     acquire(&ptable.lock);
     for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
       if(p->state != RUNNABLE)
@@ -371,6 +374,7 @@ scheduler(void)
       // to release ptable.lock and then reacquire it
       // before jumping back to us.
       c->proc = p;
+      ran = 1;
       switchuvm(p);
       p->state = RUNNING;
 
@@ -383,6 +387,9 @@ scheduler(void)
     }
     release(&ptable.lock);
 
+    // Nothing was runnable, zero a page ahead for kzalloc().
+    if(!ran)
+      kzero_refill();
   }
 }
 
@@ -504,6 +511,48 @@ wakeup(void *chan)
   release(&ptable.lock);
 }
 
+// Wake up at most n processes sleeping on chan.
+// Returns the number of processes woken.
+int
+wakeupn(void *chan, int n)
+{
+  struct proc *p;
+  int woken = 0;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC] && woken < n; p++)
+    if(p->state == SLEEPING && p->chan == chan){
+      p->state = RUNNABLE;
+      woken++;
+    }
+  release(&ptable.lock);
+  return woken;
+}
+
+// Wake p if it is sleeping on chan. For callers that keep their own
+// queue of sleepers, so no scan of the process table is needed.
+void
+wakeproc(struct proc *p, void *chan)
+{
+  acquire(&ptable.lock);
+  if(p->state == SLEEPING && p->chan == chan)
+    p->state = RUNNABLE;
+  release(&ptable.lock);
+}
+
+// Call fn(p, arg) for every process in use, holding ptable.lock.
+void
+procforeach(void (*fn)(struct proc*, void*), void *arg)
+{
+  struct proc *p;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
+    if(p->state != UNUSED)
+      fn(p, arg);
+  release(&ptable.lock);
+}
+
 // Kill the process with the given pid.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
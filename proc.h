@@ -38,6 +38,10 @@ enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 #define SHAREDREGIONS 64 // same as marco in memlayout.h
 
+// Page faults
+
+#define NFAULTKINDS 4 // same as macro in fault.h
+
 typedef struct sharedPages {
   uint key, size;
   int shmid,perm;
@@ -60,7 +64,13 @@ struct proc {
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
 
-  sharedPages pages[SHAREDREGIONS];
+  sharedPages pages[SHAREDREGIONS]; // attached segments, sorted by address
+  int nattached;               // Number of valid entries in pages
+
+  uint stackbase;              // Lowest address of the user stack, the guard page is below
+  uint faults[NFAULTKINDS];    // Page faults served, by range (see fault.h)
+  uint faultcycles[NFAULTKINDS]; // Cycles spent serving them
+  uint faultfatal;             // Page faults that killed or would kill the process, or a waited for child
 };
 
 // Process memory is laid out contiguously, low addresses first:
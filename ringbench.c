@@ -0,0 +1,111 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "ipc.h"
+#include "shm.h"
+#include "shmring.h"
+
+#define SPSCKEY 9900
+#define MPMCKEY 9901
+#define MSGS 2000
+#define SLOTS 64
+#define MAXMSG 4096
+
+char buf[MAXMSG];
+
+// removes the segment behind key, rings stay around after their users detach
+void removeRing(int key) {
+	int shmid = shmget(key, 1, 0);
+	if(shmid >= 0) {
+		shmctl(shmid, IPC_RMID, (void *)0);
+	}
+}
+
+// average cycles per message of size bytes through an spsc ring
+uint spscCycles(int size) {
+	struct spscring *r = spsc_open(SPSCKEY, SLOTS, size);
+	if(r == 0) {
+		return -1;
+	}
+	uint start = rdtsc();
+	int pid = fork();
+	if(pid == 0) {
+		for(int i = 0; i < MSGS; i++) {
+			spsc_send(r, buf, size);
+		}
+		exit();
+	}
+	for(int i = 0; i < MSGS; i++) {
+		spsc_recv(r, buf, size);
+	}
+	wait();
+	uint cycles = (rdtsc() - start) / MSGS;
+	spsc_close(r);
+	removeRing(SPSCKEY);
+	return cycles;
+}
+
+// average cycles per message of size bytes through an mpmc queue, one sender and one receiver
+uint mpmcCycles(int size) {
+	struct mpmcqueue *q = mpmc_open(MPMCKEY, SLOTS, size);
+	if(q == 0) {
+		return -1;
+	}
+	uint start = rdtsc();
+	int pid = fork();
+	if(pid == 0) {
+		for(int i = 0; i < MSGS; i++) {
+			mpmc_send(q, buf, size);
+		}
+		exit();
+	}
+	for(int i = 0; i < MSGS; i++) {
+		mpmc_recv(q, buf, size);
+	}
+	wait();
+	uint cycles = (rdtsc() - start) / MSGS;
+	mpmc_close(q);
+	removeRing(MPMCKEY);
+	return cycles;
+}
+
+// average cycles per message of size bytes through a pipe
+uint pipeCycles(int size) {
+	int fds[2];
+	if(pipe(fds) < 0) {
+		return -1;
+	}
+	uint start = rdtsc();
+	int pid = fork();
+	if(pid == 0) {
+		close(fds[0]);
+		for(int i = 0; i < MSGS; i++) {
+			write(fds[1], buf, size);
+		}
+		exit();
+	}
+	close(fds[1]);
+	for(int i = 0; i < MSGS; i++) {
+		// a pipe has no message boundaries, collect the whole message
+		for(int got = 0; got < size; ) {
+			int n = read(fds[0], buf + got, size - got);
+			if(n <= 0) {
+				break;
+			}
+			got += n;
+		}
+	}
+	wait();
+	close(fds[0]);
+	return (rdtsc() - start) / MSGS;
+}
+
+int main(int argc, char *argv[]) {
+	printf(1, "cycles/message, %d messages from a child to its parent\n", MSGS);
+	printf(1, "size, spsc, mpmc, pipe\n");
+	for(int size = 8; size <= MAXMSG; size *= 8) {
+		printf(1, "%d, %d, %d, %d\n", size, spscCycles(size), mpmcCycles(size), pipeCycles(size));
+	}
+	exit();
+}
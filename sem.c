@@ -0,0 +1,431 @@
+// System V semaphores.
+//
+// Sets use the same keys and flags as shm regions and message queues,
+// the mode is READ_SEM or RW_SEM. semop applies all of its operations
+// or none of them. A caller that has to wait queues itself on its set;
+// whoever changes the values later retries the queued operations, oldest
+// first, applies those that can complete on the waiter's behalf and
+// wakes just that process, instead of waking every sleeper in the
+// process table to retry.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "ipc.h"
+#include "sem.h"
+
+// a process blocked in semop, lives on its kernel stack
+struct semwaiter {
+  struct proc *proc;
+  struct sembuf *sops; // kernel copy of the operations
+  int nsops;
+  int sem; // semaphore of the operation that blocked, for GETNCNT / GETZCNT
+  int zero; // waiting for sem to become 0 rather than to grow
+  int status; // 1 while queued, then 0 once applied or -1 if it failed
+  struct semwaiter *next;
+};
+
+struct sem {
+  int val;
+  int pid; // last semop that changed or tested the value
+};
+
+struct semset {
+  // lock for the values and the wait queue, waiters sleep on their semwaiter
+  struct spinlock lock;
+  uint key;
+  int semid; // index in semTable, -1 while unused
+  uint gen; // bumped on IPC_RMID
+  struct sem sems[SEMMSL];
+  struct semwaiter *waiters;
+  struct semwaiter **tail; // next field of the last waiter, or &waiters
+  uint nwaiters, ops, sleeps; // reported by seminfo()
+  struct semid_ds buffer;
+};
+
+struct {
+  // lock for creating and removing sets, taken before a set's lock
+  struct spinlock lock;
+  struct semset sets[SEMMNI];
+} semTable;
+
+void
+seminit(void) {
+  initlock(&semTable.lock, "Semaphores");
+  for(int i = 0; i < SEMMNI; i++) {
+    initlock(&semTable.sets[i].lock, "Semaphore set");
+    semTable.sets[i].semid = -1;
+  }
+}
+
+// returns the id of the set for key, creating it with nsems semaphores
+// as semflag says. Looking up a set may ask for fewer semaphores, or 0
+int
+semget(uint key, int nsems, int semflag) {
+  int mode = semflag & 7;
+  struct semset *s;
+
+  semflag &= ~7;
+  // only looking up an existing key may leave out the mode
+  if(mode != READ_SEM && mode != RW_SEM && (mode != 0 || semflag != 0 || key == IPC_PRIVATE)) {
+    return -1;
+  }
+  if(key == -1 || nsems < 0 || nsems > SEMMSL) {
+    return -1;
+  }
+  acquire(&semTable.lock);
+  if(key != IPC_PRIVATE) {
+    for(s = semTable.sets; s < &semTable.sets[SEMMNI]; s++) {
+      if(s->semid != -1 && s->key == key) {
+        int semid = semflag == (IPC_CREAT | IPC_EXCL) || nsems > s->buffer.sem_nsems ? -1 : s->semid;
+        release(&semTable.lock);
+        return semid;
+      }
+    }
+    if(!(semflag & IPC_CREAT)) {
+      release(&semTable.lock);
+      return -1;
+    }
+  }
+  for(s = semTable.sets; s < &semTable.sets[SEMMNI]; s++) {
+    if(s->semid == -1) {
+      break;
+    }
+  }
+  if(nsems == 0 || s == &semTable.sets[SEMMNI]) {
+    release(&semTable.lock);
+    return -1;
+  }
+  acquire(&s->lock);
+  s->key = key;
+  memset(s->sems, 0, sizeof(s->sems));
+  s->waiters = 0;
+  s->tail = &s->waiters;
+  s->nwaiters = s->ops = s->sleeps = 0;
+  memset(&s->buffer, 0, sizeof(s->buffer));
+  s->buffer.sem_perm.__key = key;
+  s->buffer.sem_perm.mode = mode;
+  s->buffer.sem_nsems = nsems;
+  s->buffer.sem_ctime = ticks;
+  s->semid = s - semTable.sets;
+  release(&s->lock);
+  release(&semTable.lock);
+  return s->semid;
+}
+
+// Applies sops to the set if none of them has to wait, as pid.
+// Returns 0 once applied, -1 if a value would pass SEMVMX, or 1 with
+// the index of the first operation that has to wait in *block.
+// The set's lock must be held
+static int
+semtry(struct semset *s, struct sembuf *sops, int nsops, int pid, int *block) {
+  int val[SEMMSL];
+
+  for(int i = 0; i < s->buffer.sem_nsems; i++) {
+    val[i] = s->sems[i].val;
+  }
+  // an operation sees the values left by the ones before it
+  for(int i = 0; i < nsops; i++) {
+    int n = sops[i].sem_num;
+    int v = val[n] + sops[i].sem_op;
+    if(sops[i].sem_op == 0 ? val[n] != 0 : v < 0) {
+      *block = i;
+      return 1;
+    }
+    if(v > SEMVMX) {
+      return -1;
+    }
+    val[n] = v;
+  }
+  for(int i = 0; i < nsops; i++) {
+    int n = sops[i].sem_num;
+    s->sems[n].val = val[n];
+    s->sems[n].pid = pid;
+  }
+  s->buffer.sem_otime = ticks;
+  s->ops += 1;
+  return 0;
+}
+
+static void
+semunlink(struct semset *s, struct semwaiter **link) {
+  struct semwaiter *w = *link;
+  *link = w->next;
+  if(s->tail == &w->next) {
+    s->tail = link;
+  }
+  s->nwaiters -= 1;
+}
+
+// Completes the queued operations that can go ahead after the values
+// changed, oldest first, and wakes their processes. The set's lock must be held
+static void
+semwakeup(struct semset *s) {
+  struct semwaiter **link, *w;
+  int block, r;
+
+again:
+  for(link = &s->waiters; (w = *link) != 0; link = &w->next) {
+    r = semtry(s, w->sops, w->nsops, w->proc->pid, &block);
+    if(r == 1) {
+      w->sem = w->sops[block].sem_num;
+      w->zero = w->sops[block].sem_op == 0;
+      continue;
+    }
+    semunlink(s, link);
+    w->status = r;
+    wakeproc(w->proc, w);
+    // applied operations may let earlier waiters through
+    goto again;
+  }
+}
+
+// Applies the nsops operations of sops atomically, blocking until all of
+// them can be applied unless the one that has to wait has IPC_NOWAIT.
+// Returns 0, or -1 on a bad operation, IPC_NOWAIT, kill or removal of the set
+int
+semop(int semid, struct sembuf *usops, int nsops) {
+  struct sembuf sops[SEMOPM];
+  struct semwaiter w, **link;
+  struct semset *s;
+  int alter = 0, block, r;
+
+  if(semid < 0 || semid >= SEMMNI || nsops <= 0 || nsops > SEMOPM) {
+    return -1;
+  }
+  memmove(sops, usops, nsops * sizeof(struct sembuf));
+  for(int i = 0; i < nsops; i++) {
+    alter |= sops[i].sem_op != 0;
+  }
+  s = &semTable.sets[semid];
+  acquire(&s->lock);
+  // a read-only set may only be waited on for 0
+  if(s->semid == -1 || (alter && s->buffer.sem_perm.mode != RW_SEM)) {
+    goto bad;
+  }
+  for(int i = 0; i < nsops; i++) {
+    if(sops[i].sem_num >= s->buffer.sem_nsems) {
+      goto bad;
+    }
+  }
+  if((r = semtry(s, sops, nsops, myproc()->pid, &block)) == 0) {
+    if(alter) {
+      semwakeup(s);
+    }
+    release(&s->lock);
+    return 0;
+  }
+  if(r < 0 || (sops[block].sem_flg & IPC_NOWAIT)) {
+    goto bad;
+  }
+  w.proc = myproc();
+  w.sops = sops;
+  w.nsops = nsops;
+  w.sem = sops[block].sem_num;
+  w.zero = sops[block].sem_op == 0;
+  w.status = 1;
+  w.next = 0;
+  *s->tail = &w;
+  s->tail = &w.next;
+  s->nwaiters += 1;
+  s->sleeps += 1;
+  while(w.status == 1) {
+    if(myproc()->killed) {
+      for(link = &s->waiters; *link != &w; link = &(*link)->next)
+        ;
+      semunlink(s, link);
+      goto bad;
+    }
+    sleep(&w, &s->lock);
+  }
+  release(&s->lock);
+  return w.status;
+
+bad:
+  release(&s->lock);
+  return -1;
+}
+
+// true if the n bytes at the user address addr lie inside the process, like argptr
+static int
+userrange(uint addr, uint n) {
+  uint sz = myproc()->sz;
+  return addr < sz && addr + n <= sz && addr + n >= addr;
+}
+
+/*
+  Control operations on a set. arg is the value for SETVAL, a struct
+  semid_ds for IPC_STAT / IPC_SET and an array of sem_nsems ushorts for
+  GETALL / SETALL. Setting values completes the queued operations that
+  can go ahead, IPC_RMID fails all of them.
+  Returns the value asked for, 0, or -1
+*/
+int
+semctl(int semid, int semnum, int cmd, int arg) {
+  ushort vals[SEMMSL];
+  struct semid_ds ds;
+  struct semwaiter *w;
+  struct semset *s;
+  uint n, gen;
+  int r;
+
+  if(semid < 0 || semid >= SEMMNI) {
+    return -1;
+  }
+  s = &semTable.sets[semid];
+  switch(cmd) {
+    case IPC_STAT:
+      acquire(&s->lock);
+      if(s->semid == -1) {
+        release(&s->lock);
+        return -1;
+      }
+      ds = s->buffer;
+      release(&s->lock);
+      return copyout(myproc()->pgdir, (uint)arg, &ds, sizeof(ds));
+    case IPC_SET:
+      ds = *(struct semid_ds*)arg;
+      if(ds.sem_perm.mode != READ_SEM && ds.sem_perm.mode != RW_SEM) {
+        return -1;
+      }
+      acquire(&s->lock);
+      if(s->semid == -1) {
+        release(&s->lock);
+        return -1;
+      }
+      s->buffer.sem_perm.mode = ds.sem_perm.mode;
+      s->buffer.sem_ctime = ticks;
+      release(&s->lock);
+      return 0;
+    case IPC_RMID:
+      acquire(&semTable.lock);
+      acquire(&s->lock);
+      if(s->semid == -1) {
+        release(&s->lock);
+        release(&semTable.lock);
+        return -1;
+      }
+      // a woken waiter needs the lock to run, so the queue stays readable
+      for(w = s->waiters; w; w = w->next) {
+        w->status = -1;
+        wakeproc(w->proc, w);
+      }
+      s->waiters = 0;
+      s->tail = &s->waiters;
+      s->nwaiters = 0;
+      s->semid = -1;
+      s->gen += 1;
+      memset(&s->buffer, 0, sizeof(s->buffer));
+      release(&s->lock);
+      release(&semTable.lock);
+      return 0;
+    case GETALL:
+      acquire(&s->lock);
+      if(s->semid == -1) {
+        release(&s->lock);
+        return -1;
+      }
+      n = s->buffer.sem_nsems;
+      for(int i = 0; i < n; i++) {
+        vals[i] = s->sems[i].val;
+      }
+      release(&s->lock);
+      return copyout(myproc()->pgdir, (uint)arg, vals, n * sizeof(ushort));
+    case SETALL:
+      // copy the values in without the lock, the set must not change meanwhile
+      acquire(&s->lock);
+      n = s->buffer.sem_nsems;
+      gen = s->gen;
+      release(&s->lock);
+      if(!userrange(arg, n * sizeof(ushort))) {
+        return -1;
+      }
+      memmove(vals, (void*)arg, n * sizeof(ushort));
+      for(int i = 0; i < n; i++) {
+        if(vals[i] > SEMVMX) {
+          return -1;
+        }
+      }
+      acquire(&s->lock);
+      if(s->semid == -1 || s->gen != gen || s->buffer.sem_perm.mode != RW_SEM) {
+        release(&s->lock);
+        return -1;
+      }
+      for(int i = 0; i < n; i++) {
+        s->sems[i].val = vals[i];
+      }
+      s->buffer.sem_ctime = ticks;
+      semwakeup(s);
+      release(&s->lock);
+      return 0;
+  }
+
+  // commands on the single semaphore semnum
+  acquire(&s->lock);
+  if(s->semid == -1 || semnum < 0 || semnum >= s->buffer.sem_nsems) {
+    release(&s->lock);
+    return -1;
+  }
+  r = 0;
+  switch(cmd) {
+    case GETVAL:
+      r = s->sems[semnum].val;
+      break;
+    case GETPID:
+      r = s->sems[semnum].pid;
+      break;
+    case GETNCNT:
+    case GETZCNT:
+      for(w = s->waiters; w; w = w->next) {
+        if(w->sem == semnum && w->zero == (cmd == GETZCNT)) {
+          r++;
+        }
+      }
+      break;
+    case SETVAL:
+      if(arg < 0 || arg > SEMVMX || s->buffer.sem_perm.mode != RW_SEM) {
+        r = -1;
+        break;
+      }
+      s->sems[semnum].val = arg;
+      s->buffer.sem_ctime = ticks;
+      semwakeup(s);
+      break;
+    default:
+      r = -1;
+  }
+  release(&s->lock);
+  return r;
+}
+
+// copies the state of at most n live sets to the user array info,
+// returns the number of sets copied or -1 if info is not writable
+int
+seminfo(struct seminfo *info, int n) {
+  struct seminfo entry;
+  int count = 0;
+  for(int i = 0; i < SEMMNI && count < n; i++) {
+    struct semset *s = &semTable.sets[i];
+    acquire(&s->lock);
+    if(s->semid == -1) {
+      release(&s->lock);
+      continue;
+    }
+    entry.semid = s->semid;
+    entry.key = s->key;
+    entry.mode = s->buffer.sem_perm.mode;
+    entry.nsems = s->buffer.sem_nsems;
+    entry.waiters = s->nwaiters;
+    entry.ops = s->ops;
+    entry.sleeps = s->sleeps;
+    release(&s->lock);
+    if(copyout(myproc()->pgdir, (uint)&info[count], &entry, sizeof(entry)) < 0) {
+      return -1;
+    }
+    count++;
+  }
+  return count;
+}
@@ -0,0 +1,53 @@
+// System V semaphores, see sem.c. Include ipc.h first.
+
+#define SEMMNI 16   // semaphore sets in the system
+#define SEMMSL 32   // semaphores in one set
+#define SEMOPM 32   // operations in one semop call
+#define SEMVMX 32767 // largest semaphore value
+
+// read, alter
+#define READ_SEM 04
+#define RW_SEM 06
+
+// commands for semctl, besides IPC_RMID / IPC_SET / IPC_STAT
+#define GETPID 11  // pid of the last semop on semnum
+#define GETVAL 12
+#define GETALL 13  // values of every semaphore into a ushort array
+#define GETNCNT 14 // processes waiting for semnum to increase
+#define GETZCNT 15 // processes waiting for semnum to become 0
+#define SETVAL 16
+#define SETALL 17  // every value from a ushort array
+
+// one operation of semop. A positive sem_op adds to the semaphore, a
+// negative one waits until it can subtract without going below 0, and 0
+// waits until the semaphore is 0
+struct sembuf {
+  ushort sem_num;
+  short sem_op;
+  short sem_flg; // IPC_NOWAIT
+};
+
+// last argument of semctl, an int for SETVAL, a pointer otherwise
+union semun {
+  int val;
+  struct semid_ds *buf;
+  ushort *array;
+};
+
+struct semid_ds {
+  struct ipc_perm sem_perm;
+  uint sem_nsems;
+  uint sem_otime; // ticks at the last semop
+  uint sem_ctime; // ticks at creation or the last IPC_SET / SETVAL / SETALL
+};
+
+// state of one live set, filled by seminfo
+struct seminfo {
+  int semid;
+  uint key;
+  int mode; // READ_SEM / RW_SEM
+  uint nsems;
+  uint waiters; // processes blocked in semop
+  uint ops; // successful semop calls, counted since creation
+  uint sleeps; // semop calls that had to block
+};
@@ -0,0 +1,79 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+#include "sem.h"
+
+#define SHMKEY 9600
+#define ITERS 2000
+#define MAXPROCS 8
+// semaphores of the set
+#define MUTEX 0
+#define DONE 1
+
+struct seminfo info[SEMMNI];
+
+// sleeps recorded on the set semid so far
+int semSleeps(int semid) {
+	int n = seminfo(info, SEMMNI);
+	for(int i = 0; i < n; i++) {
+		if(info[i].semid == semid) {
+			return info[i].sleeps;
+		}
+	}
+	return -1;
+}
+
+// nprocs children each add ITERS to one shm counter under a semaphore,
+// prints the average cycles per increment and the sleeps it took
+void contend(int nprocs) {
+	struct sembuf lock = {MUTEX, -1, 0};
+	struct sembuf unlock = {MUTEX, 1, 0};
+	// the last unlock also signals the parent, in the same system call
+	struct sembuf unlockAndSignal[2] = {{MUTEX, 1, 0}, {DONE, 1, 0}};
+	struct sembuf waitAll = {DONE, -nprocs, 0};
+	int shmid = shmget(SHMKEY, PGSIZE, 06 | IPC_CREAT);
+	int semid = semget(IPC_PRIVATE, 2, RW_SEM);
+	volatile int *counter = (int *)shmat(shmid, (void *)0, 0);
+	if(shmid < 0 || semid < 0 || (int)counter < 0 || semctl(semid, MUTEX, SETVAL, 1) < 0) {
+		printf(1, "sembench: setup failed\n");
+		exit();
+	}
+	*counter = 0;
+	uint start = rdtsc();
+	for(int p = 0; p < nprocs; p++) {
+		if(fork() == 0) {
+			for(int i = 0; i < ITERS; i++) {
+				semop(semid, &lock, 1);
+				*counter = *counter + 1;
+				if(i == ITERS - 1) {
+					semop(semid, unlockAndSignal, 2);
+				} else {
+					semop(semid, &unlock, 1);
+				}
+			}
+			exit();
+		}
+	}
+	semop(semid, &waitAll, 1);
+	uint cycles = (rdtsc() - start) / (nprocs * ITERS);
+	for(int p = 0; p < nprocs; p++) {
+		wait();
+	}
+	printf(1, "%d, %d, %d, %s\n", nprocs, cycles, semSleeps(semid),
+		*counter == nprocs * ITERS ? "ok" : "LOST UPDATES");
+	semctl(semid, 0, IPC_RMID);
+	shmdt((void *)counter);
+	shmctl(shmid, IPC_RMID, (void *)0);
+}
+
+int main(int argc, char *argv[]) {
+	printf(1, "processes, cycles/increment, sleeps, counter\n");
+	for(int nprocs = 1; nprocs <= MAXPROCS; nprocs *= 2) {
+		contend(nprocs);
+	}
+	exit();
+}
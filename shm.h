@@ -3,8 +3,13 @@
 #define	SHM_REMAP	040000	/* take-over region on attach */
 #define	SHM_EXEC	0100000	/* execution access */
 
+// flags for shmget
+#define	SHM_LAZY	04000	/* allocate pages on first touch */
+#define	SHM_HUGETLB	010000	/* back region with 4MB pages */
+
 // flag for shmctl
 #define SHM_STAT 13
+#define SHM_RESIZE 14 /* grow or shrink the region to buf->shm_segsz bytes */
 
 #define	SHMLBA	(1 * PGSIZE) /* multiple of PGSIZE */
 
@@ -12,16 +17,32 @@
 #define READ_SHM 04
 #define RW_SHM 06
 
-struct ipc_perm {
-  uint __key; // key supplied to shmget
-  int mode; // READ - WRITE permissions. READ_SHM / RW_SHM
-  // mode = 0, while init, i.e. no permissions set
-};
-
 struct shmid_ds {
   struct ipc_perm shm_perm;
   uint shm_segsz; // size of segment in bytes
   int shm_nattch; // current attaches
   int shm_cpid; // region's creator pid
   int shm_lpid; // last attach / detach
-};
\ No newline at end of file
+  uint shm_rss; // resident pages, less than size only for SHM_LAZY regions
+};
+
+// one segment for shmatv / shmdtv
+struct shmvec {
+  int shmid; // region to attach, ignored by shmdtv
+  void *shmaddr; // requested address, set to the attach address by shmatv. Address to detach for shmdtv
+  int shmflag; // shmat flags, ignored by shmdtv
+  int ret; // 0 on success, -1 if this entry failed
+};
+
+// state of one live region, filled by shminfo
+struct shminfo {
+  int shmid;
+  uint key;
+  uint size; // bytes requested by shmget
+  int mode; // READ_SHM / RW_SHM
+  int nattch; // current attaches
+  int cpid, lpid; // creator, last attach / detach
+  int toBeDeleted; // IPC_RMID done, removed at the last detach
+  uint rss; // resident pages
+  uint attaches, detaches, faults; // counted since creation
+};
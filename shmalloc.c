@@ -0,0 +1,283 @@
+#include "types.h"
+#include "param.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+#include "shmalloc.h"
+
+// polls of a lock before waiting for it in the kernel
+#define LOCKSPINS 100
+#define CACHELINE 64
+#define LARGE 0x80000000
+// smallest piece a large free block is split into
+#define MINSPLIT 64
+
+// bytes a block of each small class can hold, as in umalloc.c
+static uint classsize[] = {
+  16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384,
+  448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+};
+#define NCLASS (sizeof(classsize)/sizeof(classsize[0]))
+#define MAXSMALL 2048
+
+// precedes every block
+struct block {
+  uint size; // class of a small block, LARGE | bytes of a large one, header included
+  uint next; // offset of the next free block, while free
+};
+
+// each bin on a cache line of its own, processes using different
+// classes do not contend
+struct bin {
+  volatile uint lock;
+  uint head; // free blocks of the class
+  char pad[CACHELINE - 2*sizeof(uint)];
+};
+
+struct shmarena {
+  volatile uint ready; // set once the creator has laid out the arena
+  volatile uint root;
+  uint size;           // bytes in the segment
+  volatile uint lock;  // for top and large
+  uint top;            // offset of the memory not handed out yet
+  uint large;          // free large blocks, sorted by offset
+  char pad[CACHELINE - 6*sizeof(uint)];
+  struct bin bins[NCLASS];
+};
+
+static uchar classof[MAXSMALL/16 + 1]; // class for (nbytes+15)/16
+
+static struct block*
+blk(struct shmarena *a, uint off)
+{
+  return (struct block*)((char*)a + off);
+}
+
+void
+shm_lock(volatile uint *l)
+{
+  uint c;
+  int i;
+
+  for(i = 0; i < LOCKSPINS; i++){
+    if(cmpxchg(l, 0, 1) == 0)
+      break;
+    asm volatile("pause");
+  }
+  if(i == LOCKSPINS){
+    // 2 is locked with possible sleepers, the unlock then wakes one
+    c = xchg(l, 2);
+    while(c != 0){
+      futex_wait((void*)l, 2);
+      c = xchg(l, 2);
+    }
+  }
+  // xchg is no compiler barrier, keep the critical section's
+  // accesses of the arena after the lock is taken
+  __sync_synchronize();
+}
+
+void
+shm_unlock(volatile uint *l)
+{
+  // and before it is released
+  __sync_synchronize();
+  if(xchg(l, 0) == 2)
+    futex_wake((void*)l, 1);
+}
+
+struct shmarena*
+shm_arena_open(int key, uint size)
+{
+  struct shmarena *a;
+  int shmid, created, i;
+  uint c;
+
+  if(classof[MAXSMALL/16] == 0){
+    for(i = 0, c = 0; i <= MAXSMALL/16; i++){
+      while(classsize[c] < i*16)
+        c++;
+      classof[i] = c;
+    }
+  }
+  // pages come in as the arena fills
+  created = 1;
+  if((shmid = shmget(key, size, 06 | IPC_CREAT | IPC_EXCL | SHM_LAZY)) < 0){
+    created = 0;
+    if((shmid = shmget(key, size, 0)) < 0)
+      return 0;
+  }
+  a = (struct shmarena*)shmat(shmid, 0, 0);
+  if((int)a == -1)
+    return 0;
+  if(!created){
+    while(a->ready == 0)
+      futex_wait((void*)&a->ready, 0);
+    return a;
+  }
+  a->size = size;
+  a->top = (sizeof(*a) + 15) & ~15;
+  a->large = 0;
+  a->lock = 0;
+  a->root = 0;
+  memset(a->bins, 0, sizeof(a->bins));
+  asm volatile("" : : : "memory");
+  a->ready = 1;
+  futex_wake((void*)&a->ready, NPROC);
+  return a;
+}
+
+// detaches the arena, the segment stays until it is removed with IPC_RMID
+void
+shm_arena_close(struct shmarena *a)
+{
+  shmdt(a);
+}
+
+uint
+shm_off(struct shmarena *a, void *p)
+{
+  return p ? (char*)p - (char*)a : 0;
+}
+
+void*
+shm_ptr(struct shmarena *a, uint off)
+{
+  return off ? (char*)a + off : 0;
+}
+
+volatile uint*
+shm_root(struct shmarena *a)
+{
+  return &a->root;
+}
+
+// offset of n fresh bytes at the top of the arena, 0 if it is full.
+// a->lock must be held
+static uint
+bump(struct shmarena *a, uint n)
+{
+  uint off = a->top;
+
+  if(n > a->size - off)
+    return 0;
+  a->top += n;
+  return off;
+}
+
+// first fit among the free large blocks, taken from the end of the block
+static uint
+malloclarge(struct shmarena *a, uint n)
+{
+  uint *link, off;
+  struct block *b;
+
+  // never fits, and the rounding below would wrap
+  if(n > a->size)
+    return 0;
+  n = (n + sizeof(struct block) + 15) & ~15;
+  shm_lock(&a->lock);
+  for(link = &a->large; (off = *link) != 0; link = &b->next){
+    b = blk(a, off);
+    if(b->size < n)
+      continue;
+    if(b->size - n >= MINSPLIT){
+      b->size -= n;
+      off += b->size;
+    } else {
+      *link = b->next;
+      n = b->size;
+    }
+    break;
+  }
+  if(off == 0)
+    off = bump(a, n);
+  shm_unlock(&a->lock);
+  if(off)
+    blk(a, off)->size = LARGE | n;
+  return off;
+}
+
+// puts the block back in the sorted list, merged with its free
+// neighbours, or back to top if it ends there
+static void
+freelarge(struct shmarena *a, uint off)
+{
+  struct block *b = blk(a, off), *p;
+  uint *link, *prevlink = 0;
+
+  b->size &= ~LARGE;
+  shm_lock(&a->lock);
+  for(link = &a->large; *link && *link < off; link = &blk(a, *link)->next)
+    prevlink = link;
+  b->next = *link;
+  if(b->next && off + b->size == b->next){
+    b->size += blk(a, b->next)->size;
+    b->next = blk(a, b->next)->next;
+  }
+  if(prevlink && *prevlink + (p = blk(a, *prevlink))->size == off){
+    p->size += b->size;
+    p->next = b->next;
+    off = *prevlink;
+    b = p;
+    link = prevlink;
+  } else
+    *link = off;
+  // the last block of the list, nothing follows it
+  if(off + b->size == a->top){
+    *link = 0;
+    a->top = off;
+  }
+  shm_unlock(&a->lock);
+}
+
+void*
+shm_malloc(struct shmarena *a, uint n)
+{
+  struct bin *bin;
+  uint c, off;
+
+  if(n > MAXSMALL){
+    off = malloclarge(a, n);
+    return off ? blk(a, off) + 1 : 0;
+  }
+  c = classof[(n + 15)/16];
+  bin = &a->bins[c];
+  shm_lock(&bin->lock);
+  if((off = bin->head) != 0)
+    bin->head = blk(a, off)->next;
+  shm_unlock(&bin->lock);
+  if(off == 0){
+    shm_lock(&a->lock);
+    off = bump(a, sizeof(struct block) + classsize[c]);
+    shm_unlock(&a->lock);
+    if(off == 0)
+      return 0;
+  }
+  blk(a, off)->size = c;
+  return blk(a, off) + 1;
+}
+
+void
+shm_free(struct shmarena *a, void *p)
+{
+  struct block *b;
+  struct bin *bin;
+  uint off;
+
+  if(p == 0)
+    return;
+  b = (struct block*)p - 1;
+  off = shm_off(a, b);
+  if(b->size & LARGE){
+    freelarge(a, off);
+    return;
+  }
+  bin = &a->bins[b->size];
+  shm_lock(&bin->lock);
+  b->next = bin->head;
+  bin->head = off;
+  shm_unlock(&bin->lock);
+}
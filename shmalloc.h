@@ -0,0 +1,27 @@
+// Heap laid out inside a shared memory segment.
+//
+// The arena is created by the first shm_arena_open for a key and
+// attached by every later one, possibly at another address in each
+// process. Data structures in the arena link their nodes by offsets
+// from the start of the arena, converted with shm_ptr / shm_off, so
+// they stay valid in every process. shm_malloc and shm_free may be
+// called by several processes at once. 0 is the null offset.
+
+struct shmarena;
+
+struct shmarena* shm_arena_open(int key, uint size);
+void shm_arena_close(struct shmarena*);
+void* shm_malloc(struct shmarena*, uint);
+void shm_free(struct shmarena*, void*);
+
+// offset of p in the arena and back, 0 for a null pointer
+uint shm_off(struct shmarena*, void*);
+void* shm_ptr(struct shmarena*, uint);
+
+// word in the arena header for the offset of the processes' first
+// node, so that later attachers can find it
+volatile uint* shm_root(struct shmarena*);
+
+// lock on a word inside the arena, spins and then sleeps in futex_wait
+void shm_lock(volatile uint*);
+void shm_unlock(volatile uint*);
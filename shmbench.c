@@ -0,0 +1,176 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+#include "memlayout.h"
+
+/*
+	Shared memory benchmarks. Every result is one line of
+		test=<name> <parameter>=<value> ... cycles=<average>
+	so runs on different kernels can be compared with a script.
+*/
+
+#define BASEKEY 12000
+#define ROUNDS 1000
+#define FORKROUNDS 50
+#define SEGPAGES 16
+#define BWSIZE (4*1024*1024)
+#define RANDOMACCESSES 100000
+
+static uint seed = 1;
+
+// small linear congruential generator, good enough to scatter accesses
+uint nextRandom(void) {
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+void report(char *test, char *param, int value, uint cycles) {
+	if(param) {
+		printf(1, "test=%s %s=%d cycles=%d\n", test, param, value, cycles);
+	} else {
+		printf(1, "test=%s cycles=%d\n", test, cycles);
+	}
+}
+
+void shmgetBench(void) {
+	uint start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		int shmid = shmget(BASEKEY, SEGPAGES*PGSIZE, 06 | IPC_CREAT | IPC_EXCL);
+		if(shmid < 0 || shmctl(shmid, IPC_RMID, (void *)0) < 0) {
+			printf(1, "shmbench: shmget create failed\n");
+			return;
+		}
+	}
+	report("shmget_create_rmid", "pages", SEGPAGES, (rdtsc() - start) / ROUNDS);
+	int shmid = shmget(BASEKEY, SEGPAGES*PGSIZE, 06 | IPC_CREAT);
+	start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		shmget(BASEKEY, SEGPAGES*PGSIZE, 0);
+	}
+	report("shmget_lookup", 0, 0, (rdtsc() - start) / ROUNDS);
+	shmctl(shmid, IPC_RMID, (void *)0);
+}
+
+void attachBench(void) {
+	int shmid = shmget(BASEKEY, SEGPAGES*PGSIZE, 06 | IPC_CREAT);
+	uint start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		void *ptr = (void *)shmat(shmid, (void *)0, 0);
+		if((int)ptr < 0 || shmdt(ptr) < 0) {
+			printf(1, "shmbench: attach failed\n");
+			break;
+		}
+	}
+	report("shmat_shmdt", "pages", SEGPAGES, (rdtsc() - start) / ROUNDS);
+	shmctl(shmid, IPC_RMID, (void *)0);
+}
+
+// fork + exit + wait with nsegs segments of SEGPAGES pages attached
+void forkBench(int nsegs) {
+	int shmids[SHAREDREGIONS];
+	for(int i = 0; i < nsegs; i++) {
+		shmids[i] = shmget(BASEKEY + 1 + i, SEGPAGES*PGSIZE, 06 | IPC_CREAT);
+		if(shmids[i] < 0 || (int)shmat(shmids[i], (void *)0, 0) < 0) {
+			printf(1, "shmbench: could not attach %d segments\n", nsegs);
+			return;
+		}
+	}
+	uint start = rdtsc();
+	for(int i = 0; i < FORKROUNDS; i++) {
+		int pid = fork();
+		if(pid == 0) {
+			exit();
+		}
+		wait();
+	}
+	report("fork_exit", "segments", nsegs, (rdtsc() - start) / FORKROUNDS);
+	// removed once the last attachment is gone, exit of this process detaches
+	for(int i = 0; i < nsegs; i++) {
+		shmctl(shmids[i], IPC_RMID, (void *)0);
+	}
+}
+
+// fork + exit + wait with one segment of kb KB attached
+void forkSizeBench(int kb) {
+	int shmid = shmget(BASEKEY, kb*1024, 06 | IPC_CREAT);
+	if(shmid < 0 || (int)shmat(shmid, (void *)0, 0) < 0) {
+		printf(1, "shmbench: could not attach %d KB\n", kb);
+		return;
+	}
+	uint start = rdtsc();
+	for(int i = 0; i < FORKROUNDS; i++) {
+		int pid = fork();
+		if(pid == 0) {
+			exit();
+		}
+		wait();
+	}
+	report("fork_exit_size", "kb", kb, (rdtsc() - start) / FORKROUNDS);
+	shmctl(shmid, IPC_RMID, (void *)0);
+}
+
+// cycles per KB for reads and writes over a BWSIZE segment
+void bandwidthBench(void) {
+	int shmid = shmget(BASEKEY, BWSIZE, 06 | IPC_CREAT);
+	int *ptr = (int *)shmat(shmid, (void *)0, 0);
+	int words = BWSIZE / sizeof(int);
+	uint sum = 0, start;
+	if(shmid < 0 || (int)ptr < 0) {
+		printf(1, "shmbench: could not attach bandwidth segment\n");
+		return;
+	}
+	start = rdtsc();
+	for(int i = 0; i < words; i++) {
+		ptr[i] = i;
+	}
+	report("seq_write", "kb", BWSIZE / 1024, (rdtsc() - start) / (BWSIZE / 1024));
+	start = rdtsc();
+	for(int i = 0; i < words; i++) {
+		sum += ptr[i];
+	}
+	report("seq_read", "kb", BWSIZE / 1024, (rdtsc() - start) / (BWSIZE / 1024));
+	start = rdtsc();
+	for(int i = 0; i < RANDOMACCESSES; i++) {
+		ptr[nextRandom() % words] = i;
+	}
+	report("rand_write", "accesses", RANDOMACCESSES, (rdtsc() - start) / RANDOMACCESSES);
+	start = rdtsc();
+	for(int i = 0; i < RANDOMACCESSES; i++) {
+		sum += ptr[nextRandom() % words];
+	}
+	report("rand_read", "accesses", RANDOMACCESSES, (rdtsc() - start) / RANDOMACCESSES);
+	// keep the reads from being optimized away
+	if(sum == 1) {
+		printf(1, " ");
+	}
+	shmdt(ptr);
+	shmctl(shmid, IPC_RMID, (void *)0);
+}
+
+int main(int argc, char *argv[]) {
+	int segs[] = {0, 1, 8, 32};
+	int kbs[] = {1024, 4096, 16384, 65536};
+	shmgetBench();
+	attachBench();
+	for(int i = 0; i < sizeof(segs)/sizeof(segs[0]); i++) {
+		// each run in its own process, so its attachments go away with it
+		if(fork() == 0) {
+			forkBench(segs[i]);
+			exit();
+		}
+		wait();
+	}
+	for(int i = 0; i < sizeof(kbs)/sizeof(kbs[0]); i++) {
+		if(fork() == 0) {
+			forkSizeBench(kbs[i]);
+			exit();
+		}
+		wait();
+	}
+	bandwidthBench();
+	exit();
+}
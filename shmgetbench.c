@@ -0,0 +1,67 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "ipc.h"
+#include "shm.h"
+#include "memlayout.h"
+
+// key measured in both runs, fillers use the keys after it
+#define BENCHKEY 9000
+#define ROUNDS 1000
+
+// average cycles for looking up an existing key
+uint lookupCycles(uint key) {
+	uint start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		if(shmget(key, 100, 0) < 0) {
+			return -1;
+		}
+	}
+	return (rdtsc() - start) / ROUNDS;
+}
+
+// average cycles for creating and removing a fresh region
+uint createCycles(uint key) {
+	uint start = rdtsc();
+	for(int i = 0; i < ROUNDS; i++) {
+		int shmid = shmget(key, 100, 06 | IPC_CREAT | IPC_EXCL);
+		if(shmid < 0 || shmctl(shmid, IPC_RMID, (void *)0) < 0) {
+			return -1;
+		}
+	}
+	return (rdtsc() - start) / ROUNDS;
+}
+
+// runs both measurements with `fillers` other regions in the table
+void run(int fillers) {
+	int shmids[SHAREDREGIONS];
+	for(int i = 0; i < fillers; i++) {
+		shmids[i] = shmget(BENCHKEY + 1 + i, 100, 06 | IPC_CREAT);
+		if(shmids[i] < 0) {
+			printf(1, "shmgetbench: could not fill table\n");
+			exit();
+		}
+	}
+	// created last, so a linear scan would have to pass every filler
+	int shmid = shmget(BENCHKEY, 100, 06 | IPC_CREAT);
+	if(shmid < 0) {
+		printf(1, "shmgetbench: could not create region\n");
+		exit();
+	}
+	printf(1, "%d regions in use:\n", fillers + 1);
+	printf(1, "\t- shmget lookup : %d cycles/op\n", lookupCycles(BENCHKEY));
+	printf(1, "\t- shmget create + IPC_RMID : %d cycles/op\n", createCycles(BENCHKEY - 1));
+	shmctl(shmid, IPC_RMID, (void *)0);
+	for(int i = 0; i < fillers; i++) {
+		shmctl(shmids[i], IPC_RMID, (void *)0);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	// empty table
+	run(0);
+	// leave one region free for the create test
+	run(SHAREDREGIONS - 2);
+	exit();
+}
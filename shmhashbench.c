@@ -0,0 +1,184 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+#include "shmalloc.h"
+
+/*
+	N processes build one hash table inside a shmalloc arena. Each
+	process attaches the arena at an address of its own, inserts its
+	share of the keys, looks up every key once all have inserted, and
+	removes its keys again. Prints the cycles per insert, lookup and
+	remove, averaged over the processes.
+*/
+
+#define ARENAKEY 9800
+#define SPACERKEY 9801
+#define ARENASIZE (4*1024*1024)
+#define KEYS 8000
+#define BUCKETS 1024
+#define MAXPROCS 4
+
+struct entry {
+	uint next; // offset of the next entry of the bucket
+	int key, value;
+};
+
+struct bucket {
+	volatile uint lock;
+	uint head;
+};
+
+struct table {
+	volatile uint inserted, looked; // processes done with each phase
+	volatile uint cycles[3];        // summed over the processes
+	volatile uint errors;
+	struct bucket buckets[BUCKETS];
+};
+
+struct shmarena *arena;
+
+struct table* tableOpen(void) {
+	volatile uint *root = shm_root(arena);
+	struct table *t;
+	if(*root == 0) {
+		if((t = shm_malloc(arena, sizeof(*t))) == 0) {
+			return 0;
+		}
+		memset(t, 0, sizeof(*t));
+		// publish, or drop ours if another process was first
+		if(cmpxchg(root, 0, shm_off(arena, t)) != 0) {
+			shm_free(arena, t);
+		}
+	}
+	return shm_ptr(arena, *root);
+}
+
+void insert(struct table *t, int key, int value) {
+	struct entry *e = shm_malloc(arena, sizeof(*e));
+	struct bucket *b = &t->buckets[key % BUCKETS];
+	if(e == 0) {
+		xaddl(&t->errors, 1);
+		return;
+	}
+	e->key = key;
+	e->value = value;
+	shm_lock(&b->lock);
+	e->next = b->head;
+	b->head = shm_off(arena, e);
+	shm_unlock(&b->lock);
+}
+
+// the value stored for key, -1 if it is missing
+int lookup(struct table *t, int key) {
+	struct bucket *b = &t->buckets[key % BUCKETS];
+	int value = -1;
+	shm_lock(&b->lock);
+	for(struct entry *e = shm_ptr(arena, b->head); e; e = shm_ptr(arena, e->next)) {
+		if(e->key == key) {
+			value = e->value;
+			break;
+		}
+	}
+	shm_unlock(&b->lock);
+	return value;
+}
+
+void removeKey(struct table *t, int key) {
+	struct bucket *b = &t->buckets[key % BUCKETS];
+	struct entry *e = 0;
+	shm_lock(&b->lock);
+	for(uint *link = &b->head; *link; link = &e->next) {
+		e = shm_ptr(arena, *link);
+		if(e->key == key) {
+			*link = e->next;
+			shm_unlock(&b->lock);
+			shm_free(arena, e);
+			return;
+		}
+	}
+	shm_unlock(&b->lock);
+}
+
+void waitFor(volatile uint *word, uint n) {
+	uint seen;
+	while((seen = *word) < n) {
+		futex_wait((void *)word, seen);
+	}
+}
+
+void bump(volatile uint *word) {
+	xaddl(word, 1);
+	futex_wake((void *)word, MAXPROCS);
+}
+
+void worker(int me, int nprocs) {
+	// one page per earlier worker ahead of the arena, so each attaches it elsewhere
+	int spacer = shmget(SPACERKEY, PGSIZE, 06 | IPC_CREAT);
+	for(int i = 0; i < me; i++) {
+		shmat(spacer, (void *)0, 0);
+	}
+	if((arena = shm_arena_open(ARENAKEY, ARENASIZE)) == 0) {
+		printf(1, "shmhashbench: arena open failed\n");
+		exit();
+	}
+	struct table *t = tableOpen();
+	if(t == 0) {
+		printf(1, "shmhashbench: no table\n");
+		exit();
+	}
+	uint start = rdtsc();
+	for(int key = me; key < KEYS; key += nprocs) {
+		insert(t, key, key * 3);
+	}
+	xaddl(&t->cycles[0], rdtsc() - start);
+	bump(&t->inserted);
+	waitFor(&t->inserted, nprocs);
+	start = rdtsc();
+	for(int key = 0; key < KEYS; key++) {
+		if(lookup(t, key) != key * 3) {
+			xaddl(&t->errors, 1);
+		}
+	}
+	xaddl(&t->cycles[1], rdtsc() - start);
+	bump(&t->looked);
+	waitFor(&t->looked, nprocs);
+	start = rdtsc();
+	for(int key = me; key < KEYS; key += nprocs) {
+		removeKey(t, key);
+	}
+	xaddl(&t->cycles[2], rdtsc() - start);
+	exit();
+}
+
+void run(int nprocs) {
+	for(int i = 0; i < nprocs; i++) {
+		if(fork() == 0) {
+			worker(i, nprocs);
+		}
+	}
+	for(int i = 0; i < nprocs; i++) {
+		wait();
+	}
+	if((arena = shm_arena_open(ARENAKEY, ARENASIZE)) == 0) {
+		printf(1, "shmhashbench: arena open failed\n");
+		exit();
+	}
+	struct table *t = shm_ptr(arena, *shm_root(arena));
+	printf(1, "%d, %d, %d, %d, %s\n", nprocs, t->cycles[0] / KEYS, t->cycles[1] / (KEYS * nprocs),
+		t->cycles[2] / KEYS, t->errors ? "ERRORS" : "ok");
+	shm_arena_close(arena);
+	shmctl(shmget(ARENAKEY, ARENASIZE, 0), IPC_RMID, (void *)0);
+	shmctl(shmget(SPACERKEY, PGSIZE, 0), IPC_RMID, (void *)0);
+}
+
+int main(int argc, char *argv[]) {
+	printf(1, "processes, insert cycles, lookup cycles, remove cycles, table\n");
+	for(int nprocs = 1; nprocs <= MAXPROCS; nprocs *= 2) {
+		run(nprocs);
+	}
+	exit();
+}
@@ -0,0 +1,369 @@
+#include "types.h"
+#include "param.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+#include "shmring.h"
+
+// polls of the ring before a blocking call sleeps in the kernel
+#define RINGSPINS 1000
+// header words of a ring, the rest of its first cache lines is padding
+#define PAD(words) (CACHELINE - (words)*sizeof(uint))
+
+struct spscring {
+  volatile uint head;     // next slot to receive, only the consumer writes it
+  char pad0[PAD(1)];
+  volatile uint tail;     // next slot to send, only the producer writes it
+  char pad1[PAD(1)];
+  volatile uint waiters;  // processes sleeping on head or tail
+  volatile uint ready;    // set once the creator has laid out the ring
+  uint mask;              // slots - 1
+  uint slotsize;          // length word + message, rounded to CACHELINE
+  char pad2[PAD(4)];
+};
+
+struct mpmcqueue {
+  volatile uint enqueue;  // next cell to claim for sending
+  volatile uint pushes;   // completed sends, blocked receivers sleep on it
+  char pad0[PAD(2)];
+  volatile uint dequeue;  // next cell to claim for receiving
+  volatile uint pops;     // completed receives, blocked senders sleep on it
+  char pad1[PAD(2)];
+  volatile uint waiters;
+  volatile uint ready;
+  uint mask;
+  uint slotsize;          // sequence + length word + message, rounded to CACHELINE
+  char pad2[PAD(4)];
+};
+
+// A cell of the mpmc queue is free for the send at position pos when
+// its seq equals pos, and holds a message for the receive at pos when
+// seq equals pos + 1.
+struct cell {
+  volatile uint seq;
+  uint len;
+};
+
+// keeps the compiler from moving memory accesses across it, x86 itself
+// does not reorder stores with stores or loads with loads
+static inline void
+barrier(void)
+{
+  asm volatile("" : : : "memory");
+}
+
+// full fence, orders a store before a later load
+static inline void
+fence(void)
+{
+  asm volatile("lock; addl $0, (%%esp)" : : : "memory", "cc");
+}
+
+static uint
+roundpow2(uint n)
+{
+  uint p = 1;
+  while(p < n)
+    p <<= 1;
+  return p;
+}
+
+// Creates the segment for key and returns it attached, with *created set,
+// or attaches the existing one. Returns 0 on failure.
+static void*
+ringattach(int key, uint size, int *created)
+{
+  int shmid;
+  void *mem;
+
+  *created = 1;
+  if((shmid = shmget(key, size, 06 | IPC_CREAT | IPC_EXCL)) < 0){
+    *created = 0;
+    if((shmid = shmget(key, size, 0)) < 0)
+      return 0;
+  }
+  mem = (void*)shmat(shmid, 0, 0);
+  if((int)mem == -1)
+    return 0;
+  return mem;
+}
+
+// waits for the creator to finish the layout
+static void
+ringready(volatile uint *ready)
+{
+  while(*ready == 0)
+    futex_wait((void*)ready, 0);
+  barrier();
+}
+
+// Sleeps until *word is no longer seen, after polling it for a while.
+// The other side calls ringwake after changing word.
+static void
+ringwait(volatile uint *word, uint seen, volatile uint *waiters)
+{
+  int i;
+
+  for(i = 0; i < RINGSPINS; i++){
+    if(*word != seen)
+      return;
+    asm volatile("pause");
+  }
+  // locked, so a waker that misses this count already changed word
+  xaddl(waiters, 1);
+  futex_wait((void*)word, seen);
+  xaddl(waiters, -1);
+}
+
+static void
+ringwake(volatile uint *word, volatile uint *waiters)
+{
+  fence();
+  if(*waiters)
+    futex_wake((void*)word, 1);
+}
+
+struct spscring*
+spsc_open(int key, uint slots, uint msgsize)
+{
+  struct spscring *r;
+  uint slotsize;
+  int created;
+
+  slots = roundpow2(slots);
+  slotsize = (sizeof(uint) + msgsize + CACHELINE-1) & ~(CACHELINE-1);
+  if((r = ringattach(key, sizeof(*r) + slots*slotsize, &created)) == 0)
+    return 0;
+  if(!created){
+    ringready(&r->ready);
+    return r;
+  }
+  r->head = r->tail = r->waiters = 0;
+  r->mask = slots - 1;
+  r->slotsize = slotsize;
+  barrier();
+  r->ready = 1;
+  futex_wake((void*)&r->ready, NPROC);
+  return r;
+}
+
+static char*
+spscslot(struct spscring *r, uint pos)
+{
+  return (char*)(r + 1) + (pos & r->mask) * r->slotsize;
+}
+
+int
+spsc_trysend(struct spscring *r, const void *msg, uint len)
+{
+  uint tail = r->tail;
+  char *slot;
+
+  if(len > r->slotsize - sizeof(uint) || tail - r->head > r->mask)
+    return -1;
+  slot = spscslot(r, tail);
+  *(uint*)slot = len;
+  memmove(slot + sizeof(uint), msg, len);
+  barrier();
+  r->tail = tail + 1;
+  ringwake(&r->tail, &r->waiters);
+  return 0;
+}
+
+// Copies at most len bytes of the next message into buf.
+// Returns the length of the message.
+int
+spsc_tryrecv(struct spscring *r, void *buf, uint len)
+{
+  uint head = r->head;
+  uint msglen;
+  char *slot;
+
+  if(head == r->tail)
+    return -1;
+  barrier();
+  slot = spscslot(r, head);
+  msglen = *(uint*)slot;
+  memmove(buf, slot + sizeof(uint), msglen < len ? msglen : len);
+  barrier();
+  r->head = head + 1;
+  ringwake(&r->head, &r->waiters);
+  return msglen;
+}
+
+int
+spsc_send(struct spscring *r, const void *msg, uint len)
+{
+  uint head;
+
+  if(len > r->slotsize - sizeof(uint))
+    return -1;
+  for(;;){
+    head = r->head;
+    if(spsc_trysend(r, msg, len) == 0)
+      return 0;
+    ringwait(&r->head, head, &r->waiters);
+  }
+}
+
+int
+spsc_recv(struct spscring *r, void *buf, uint len)
+{
+  uint tail;
+  int n;
+
+  for(;;){
+    tail = r->tail;
+    if((n = spsc_tryrecv(r, buf, len)) >= 0)
+      return n;
+    ringwait(&r->tail, tail, &r->waiters);
+  }
+}
+
+// detaches the ring, the segment stays until it is removed with IPC_RMID
+void
+spsc_close(struct spscring *r)
+{
+  shmdt(r);
+}
+
+struct mpmcqueue*
+mpmc_open(int key, uint slots, uint msgsize)
+{
+  struct mpmcqueue *q;
+  uint slotsize, i;
+  int created;
+
+  slots = roundpow2(slots);
+  slotsize = (sizeof(struct cell) + msgsize + CACHELINE-1) & ~(CACHELINE-1);
+  if((q = ringattach(key, sizeof(*q) + slots*slotsize, &created)) == 0)
+    return 0;
+  if(!created){
+    ringready(&q->ready);
+    return q;
+  }
+  q->enqueue = q->pushes = q->dequeue = q->pops = q->waiters = 0;
+  q->mask = slots - 1;
+  q->slotsize = slotsize;
+  for(i = 0; i < slots; i++)
+    ((struct cell*)((char*)(q + 1) + i*slotsize))->seq = i;
+  barrier();
+  q->ready = 1;
+  futex_wake((void*)&q->ready, NPROC);
+  return q;
+}
+
+static struct cell*
+mpmccell(struct mpmcqueue *q, uint pos)
+{
+  return (struct cell*)((char*)(q + 1) + (pos & q->mask) * q->slotsize);
+}
+
+int
+mpmc_trysend(struct mpmcqueue *q, const void *msg, uint len)
+{
+  uint pos;
+  struct cell *c;
+
+  if(len > q->slotsize - sizeof(struct cell))
+    return -1;
+  pos = q->enqueue;
+  for(;;){
+    c = mpmccell(q, pos);
+    int dif = (int)(c->seq - pos);
+    if(dif == 0){
+      // free cell, claim it
+      uint seen = cmpxchg(&q->enqueue, pos, pos + 1);
+      if(seen == pos)
+        break;
+      pos = seen;
+    } else if(dif < 0){
+      // the cell still holds the message from a lap ago, full
+      return -1;
+    } else {
+      pos = q->enqueue;
+    }
+  }
+  c->len = len;
+  memmove(c + 1, msg, len);
+  barrier();
+  c->seq = pos + 1;
+  xaddl(&q->pushes, 1);
+  if(q->waiters)
+    futex_wake((void*)&q->pushes, 1);
+  return 0;
+}
+
+// Copies at most len bytes of the next message into buf.
+// Returns the length of the message.
+int
+mpmc_tryrecv(struct mpmcqueue *q, void *buf, uint len)
+{
+  uint pos, msglen;
+  struct cell *c;
+
+  pos = q->dequeue;
+  for(;;){
+    c = mpmccell(q, pos);
+    int dif = (int)(c->seq - (pos + 1));
+    if(dif == 0){
+      uint seen = cmpxchg(&q->dequeue, pos, pos + 1);
+      if(seen == pos)
+        break;
+      pos = seen;
+    } else if(dif < 0){
+      // nothing sent to this cell yet, empty
+      return -1;
+    } else {
+      pos = q->dequeue;
+    }
+  }
+  barrier();
+  msglen = c->len;
+  memmove(buf, c + 1, msglen < len ? msglen : len);
+  barrier();
+  // free for the send one lap later
+  c->seq = pos + q->mask + 1;
+  xaddl(&q->pops, 1);
+  if(q->waiters)
+    futex_wake((void*)&q->pops, 1);
+  return msglen;
+}
+
+int
+mpmc_send(struct mpmcqueue *q, const void *msg, uint len)
+{
+  uint pops;
+
+  if(len > q->slotsize - sizeof(struct cell))
+    return -1;
+  for(;;){
+    pops = q->pops;
+    if(mpmc_trysend(q, msg, len) == 0)
+      return 0;
+    ringwait(&q->pops, pops, &q->waiters);
+  }
+}
+
+int
+mpmc_recv(struct mpmcqueue *q, void *buf, uint len)
+{
+  uint pushes;
+  int n;
+
+  for(;;){
+    pushes = q->pushes;
+    if((n = mpmc_tryrecv(q, buf, len)) >= 0)
+      return n;
+    ringwait(&q->pushes, pushes, &q->waiters);
+  }
+}
+
+// detaches the queue, the segment stays until it is removed with IPC_RMID
+void
+mpmc_close(struct mpmcqueue *q)
+{
+  shmdt(q);
+}
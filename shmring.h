@@ -0,0 +1,29 @@
+// Message rings laid out inside a shared memory segment.
+//
+// A ring is created by the first spsc_open / mpmc_open for a key and
+// attached by every later one. All state lives in the segment, so the
+// processes may attach it at different addresses. The try functions
+// never block and return -1 if the ring is full or empty. The others
+// spin for a while, then sleep with futex_wait until the other side
+// makes progress.
+
+#define CACHELINE 64
+
+struct spscring;
+struct mpmcqueue;
+
+// single producer, single consumer
+struct spscring* spsc_open(int key, uint slots, uint msgsize);
+int spsc_trysend(struct spscring*, const void*, uint);
+int spsc_tryrecv(struct spscring*, void*, uint);
+int spsc_send(struct spscring*, const void*, uint);
+int spsc_recv(struct spscring*, void*, uint);
+void spsc_close(struct spscring*);
+
+// bounded queue, any number of producers and consumers
+struct mpmcqueue* mpmc_open(int key, uint slots, uint msgsize);
+int mpmc_trysend(struct mpmcqueue*, const void*, uint);
+int mpmc_tryrecv(struct mpmcqueue*, void*, uint);
+int mpmc_send(struct mpmcqueue*, const void*, uint);
+int mpmc_recv(struct mpmcqueue*, void*, uint);
+void mpmc_close(struct mpmcqueue*);
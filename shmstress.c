@@ -0,0 +1,74 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+
+// every worker uses its own key, so the regions are unrelated
+#define BASEKEY 11000
+#define SEGSIZE (32*PGSIZE)
+#define ROUNDS 2000
+#define MAXWORKERS 8
+
+// attach / detach own region ROUNDS times
+void worker(int id) {
+	int shmid = shmget(BASEKEY + id, SEGSIZE, 06 | IPC_CREAT);
+	if(shmid < 0) {
+		printf(1, "shmstress: shmget failed in worker %d\n", id);
+		exit();
+	}
+	for(int i = 0; i < ROUNDS; i++) {
+		char *ptr = (char *)shmat(shmid, (void *)0, 0);
+		if((int)ptr < 0 || shmdt(ptr) < 0) {
+			printf(1, "shmstress: attach / detach failed in worker %d\n", id);
+			exit();
+		}
+	}
+	exit();
+}
+
+// run `workers` processes at once, returns elapsed ticks
+int run(int workers) {
+	int start = uptime();
+	for(int i = 0; i < workers; i++) {
+		int pid = fork();
+		if(pid < 0) {
+			printf(1, "shmstress: fork failed\n");
+			return -1;
+		} else if(pid == 0) {
+			worker(i);
+		}
+	}
+	for(int i = 0; i < workers; i++) {
+		wait();
+	}
+	return uptime() - start;
+}
+
+int main(int argc, char *argv[]) {
+	// largest number of concurrent workers, defaults to NCPU
+	int maxWorkers = argc > 1 ? atoi(argv[1]) : MAXWORKERS;
+	if(maxWorkers < 1 || maxWorkers > MAXWORKERS) {
+		printf(1, "usage: shmstress [workers 1-%d]\n", MAXWORKERS);
+		exit();
+	}
+	printf(1, "attach + detach of a %d page region, %d rounds per worker\n", SEGSIZE / PGSIZE, ROUNDS);
+	for(int workers = 1; workers <= maxWorkers; workers *= 2) {
+		int ticks = run(workers);
+		if(ticks < 0) {
+			break;
+		}
+		// avoid dividing by zero on very fast runs
+		int ops = workers * ROUNDS;
+		printf(1, "\t- %d workers : %d ops in %d ticks, %d ops/tick\n", workers, ops, ticks, ops / (ticks ? ticks : 1));
+	}
+	// workers leave their regions behind, remove them
+	for(int i = 0; i < maxWorkers; i++) {
+		int shmid = shmget(BASEKEY + i, SEGSIZE, 0);
+		if(shmid >= 0) {
+			shmctl(shmid, IPC_RMID, (void *)0);
+		}
+	}
+	exit();
+}
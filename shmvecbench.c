@@ -0,0 +1,65 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+
+// segments a worker attaches at startup
+#define NWORKSEGS 32
+#define BASEKEY 9700
+#define ROUNDS 200
+
+int shmids[NWORKSEGS];
+struct shmvec vec[NWORKSEGS];
+
+// average cycles to attach and detach all segments, one call each
+uint scalarCycles(void) {
+	void *ptrs[NWORKSEGS];
+	uint start = rdtsc();
+	for(int r = 0; r < ROUNDS; r++) {
+		for(int i = 0; i < NWORKSEGS; i++) {
+			ptrs[i] = (void *)shmat(shmids[i], (void *)0, 0);
+		}
+		for(int i = 0; i < NWORKSEGS; i++) {
+			if(shmdt(ptrs[i]) < 0) {
+				return -1;
+			}
+		}
+	}
+	return (rdtsc() - start) / ROUNDS;
+}
+
+// average cycles to attach and detach all segments with one shmatv and one shmdtv
+uint vectorCycles(void) {
+	uint start = rdtsc();
+	for(int r = 0; r < ROUNDS; r++) {
+		for(int i = 0; i < NWORKSEGS; i++) {
+			vec[i].shmid = shmids[i];
+			vec[i].shmaddr = (void *)0;
+			vec[i].shmflag = 0;
+		}
+		if(shmatv(vec, NWORKSEGS) != NWORKSEGS || shmdtv(vec, NWORKSEGS) != NWORKSEGS) {
+			return -1;
+		}
+	}
+	return (rdtsc() - start) / ROUNDS;
+}
+
+int main(int argc, char *argv[]) {
+	for(int i = 0; i < NWORKSEGS; i++) {
+		shmids[i] = shmget(BASEKEY + i, PGSIZE, 06 | IPC_CREAT);
+		if(shmids[i] < 0) {
+			printf(1, "shmvecbench: shmget failed\n");
+			exit();
+		}
+	}
+	printf(1, "attach + detach of %d segments:\n", NWORKSEGS);
+	printf(1, "\t- shmat / shmdt : %d cycles\n", scalarCycles());
+	printf(1, "\t- shmatv / shmdtv : %d cycles\n", vectorCycles());
+	for(int i = 0; i < NWORKSEGS; i++) {
+		shmctl(shmids[i], IPC_RMID, (void *)0);
+	}
+	exit();
+}
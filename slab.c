@@ -0,0 +1,218 @@
+// Slab allocator for kernel objects smaller than a page.
+//
+// Each cache carves pages from kalloc() into objects of one size.
+// A page (slab) starts with a struct slab, followed by the objects;
+// the free objects of a slab are linked through their first word.
+// objfree() finds the slab of an object by rounding its address
+// down to the page.
+//
+// On top of the slabs each CPU has a magazine of objects per cache,
+// so most objalloc() and objfree() calls touch neither the cache lock
+// nor the slabs. An empty magazine is refilled with MAGSIZE/2 objects
+// under the lock, a full one gives MAGSIZE/2 back.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "slab.h"
+#include "memstat.h"
+
+struct freeobj {
+  struct freeobj *next;
+};
+
+struct slab {
+  struct slab *next;      // on the partial list
+  struct slab *prev;
+  struct objcache *cache;
+  struct freeobj *free;
+  uint inuse;
+};
+
+// objects start after the header, 8-byte aligned
+#define SLABHDR ((sizeof(struct slab) + 7) & ~7)
+
+struct {
+  struct spinlock lock;
+  struct objcache *list;
+} caches;
+
+void
+slabinit(void)
+{
+  initlock(&caches.lock, "caches");
+}
+
+// Set up c for objects of size bytes. Pages are only
+// allocated once the first object is.
+void
+objcache_init(struct objcache *c, char *name, uint size)
+{
+  size = (size + 7) & ~7;
+  if(size < sizeof(struct freeobj) || size > PGSIZE - SLABHDR)
+    panic("objcache_init");
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->perslab = (PGSIZE - SLABHDR) / size;
+
+  acquire(&caches.lock);
+  c->next = caches.list;
+  caches.list = c;
+  release(&caches.lock);
+}
+
+static void
+partial_remove(struct objcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+partial_insert(struct objcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(s->next)
+    s->next->prev = s;
+  c->partial = s;
+}
+
+// Take a free object from the slabs, growing the cache by a page
+// if they are all full. Caller holds c->lock.
+static void*
+slab_get(struct objcache *c)
+{
+  struct slab *s;
+  struct freeobj *o;
+  char *p;
+  uint i;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->inuse = 0;
+    s->free = 0;
+    p = (char*)s + SLABHDR;
+    for(i = 0; i < c->perslab; i++){
+      o = (struct freeobj*)(p + i*c->size);
+      o->next = s->free;
+      s->free = o;
+    }
+    partial_insert(c, s);
+    c->nslabs++;
+  }
+  o = s->free;
+  s->free = o->next;
+  s->inuse++;
+  if(s->free == 0)
+    partial_remove(c, s);
+  c->nout++;
+  return o;
+}
+
+// Return obj to its slab. A slab that becomes empty is given back
+// to kalloc unless it is the only one with free objects left.
+// Caller holds c->lock.
+static void
+slab_put(struct objcache *c, void *obj)
+{
+  struct slab *s = (struct slab*)PGROUNDDOWN((uint)obj);
+  struct freeobj *o = obj;
+
+  if(s->cache != c)
+    panic("objfree: wrong cache");
+  if(s->free == 0)
+    partial_insert(c, s);
+  o->next = s->free;
+  s->free = o;
+  s->inuse--;
+  c->nout--;
+  if(s->inuse == 0 && (s->next || s->prev)){
+    partial_remove(c, s);
+    c->nslabs--;
+    kfree((char*)s);
+  }
+}
+
+// Allocate an object from c.
+// Returns 0 if there is no memory for a new slab.
+void*
+objalloc(struct objcache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slab_get(c)) != 0)
+      m->objs[m->n++] = obj;
+    release(&c->lock);
+  }
+  obj = m->n > 0 ? m->objs[--m->n] : 0;
+  popcli();
+  return obj;
+}
+
+// Free an object returned by objalloc(c).
+void
+objfree(struct objcache *c, void *obj)
+{
+  struct magazine *m;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slab_put(c, m->objs[--m->n]);
+    release(&c->lock);
+  }
+  m->objs[m->n++] = obj;
+  popcli();
+}
+
+// copies the counters of at most n caches to the user array st,
+// returns the number of caches copied or -1 if st is not writable
+int
+slabstat(struct slabstat *st, int n)
+{
+  struct slabstat entry;
+  struct objcache *c;
+  int count, i;
+
+  count = 0;
+  acquire(&caches.lock);
+  for(c = caches.list; c && count < n; c = c->next){
+    memset(&entry, 0, sizeof(entry));
+    safestrcpy(entry.name, c->name, sizeof(entry.name));
+    acquire(&c->lock);
+    entry.objsize = c->size;
+    entry.perslab = c->perslab;
+    entry.slabs = c->nslabs;
+    for(i = 0; i < NCPU; i++)
+      entry.cached += c->mag[i].n;
+    entry.inuse = c->nout - entry.cached;
+    release(&c->lock);
+    release(&caches.lock);
+    // copyout may have to copy a copy-on-write page, do it unlocked
+    if(copyout(myproc()->pgdir, (uint)&st[count], &entry, sizeof(entry)) < 0)
+      return -1;
+    count++;
+    acquire(&caches.lock);
+  }
+  release(&caches.lock);
+  return count;
+}
@@ -0,0 +1,21 @@
+// Caches of small, equally sized kernel objects, see slab.c.
+
+#define MAGSIZE 8  // objects each CPU keeps at hand per cache
+
+// Objects a CPU took from or freed to a cache, reused without its lock.
+struct magazine {
+  uint n;
+  void *objs[MAGSIZE];
+};
+
+struct objcache {
+  struct spinlock lock;
+  char *name;
+  uint size;              // object size, rounded up to a multiple of 8
+  uint perslab;           // objects in one slab page
+  struct slab *partial;   // slabs with at least one free object
+  uint nslabs;            // pages held by the cache
+  uint nout;              // objects not free in a slab, including magazines
+  struct magazine mag[NCPU];
+  struct objcache *next;  // all caches, for slabstat()
+};
@@ -2,6 +2,10 @@
 struct spinlock {
   uint locked;       // Is the lock held?
 
+  // Statistics, updated by the holder:
+  uint nacquire;     // Number of times the lock was taken.
+  uint ncontended;   // How many of those had to wait for another holder.
+
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
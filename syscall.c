@@ -109,6 +109,24 @@ extern int sys_shmget(void);
 extern int sys_shmat(void);
 extern int sys_shmdt(void);
 extern int sys_shmctl(void);
+extern int sys_shmcount(void);
+extern int sys_shmatv(void);
+extern int sys_shmdtv(void);
+extern int sys_futex_wait(void);
+extern int sys_futex_wake(void);
+extern int sys_shminfo(void);
+extern int sys_memstat(void);
+extern int sys_slabstat(void);
+extern int sys_msgget(void);
+extern int sys_msgsnd(void);
+extern int sys_msgrcv(void);
+extern int sys_msgctl(void);
+extern int sys_msginfo(void);
+extern int sys_semget(void);
+extern int sys_semop(void);
+extern int sys_semctl(void);
+extern int sys_seminfo(void);
+extern int sys_faultstat(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -137,6 +155,24 @@ static int (*syscalls[])(void) = {
 [SYS_shmat]  sys_shmat,
 [SYS_shmdt]  sys_shmdt,
 [SYS_shmctl] sys_shmctl,
+[SYS_shmcount] sys_shmcount,
+[SYS_shmatv] sys_shmatv,
+[SYS_shmdtv] sys_shmdtv,
+[SYS_futex_wait] sys_futex_wait,
+[SYS_futex_wake] sys_futex_wake,
+[SYS_shminfo] sys_shminfo,
+[SYS_memstat] sys_memstat,
+[SYS_slabstat] sys_slabstat,
+[SYS_msgget]  sys_msgget,
+[SYS_msgsnd]  sys_msgsnd,
+[SYS_msgrcv]  sys_msgrcv,
+[SYS_msgctl]  sys_msgctl,
+[SYS_msginfo] sys_msginfo,
+[SYS_semget]  sys_semget,
+[SYS_semop]   sys_semop,
+[SYS_semctl]  sys_semctl,
+[SYS_seminfo] sys_seminfo,
+[SYS_faultstat] sys_faultstat,
 };
 
 void
@@ -25,4 +25,22 @@
 #define SYS_shmget 22
 #define SYS_shmat  23
 #define SYS_shmdt  24
-#define SYS_shmctl 25
\ No newline at end of file
+#define SYS_shmctl 25
+#define SYS_shmcount 26
+#define SYS_shmatv 27
+#define SYS_shmdtv 28
+#define SYS_futex_wait 29
+#define SYS_futex_wake 30
+#define SYS_shminfo 31
+#define SYS_memstat 32
+#define SYS_slabstat 33
+#define SYS_msgget 34
+#define SYS_msgsnd 35
+#define SYS_msgrcv 36
+#define SYS_msgctl 37
+#define SYS_msginfo 38
+#define SYS_semget 39
+#define SYS_semop 40
+#define SYS_semctl 41
+#define SYS_seminfo 42
+#define SYS_faultstat 43
\ No newline at end of file
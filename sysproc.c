@@ -6,6 +6,12 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "ipc.h"
+#include "shm.h"
+#include "msg.h"
+#include "sem.h"
+#include "memstat.h"
+#include "fault.h"
 
 int
 sys_fork(void)
@@ -90,12 +96,56 @@ sys_uptime(void)
   return xticks;
 }
 
+// copy physical memory statistics to the user's struct memstat
+int
+sys_memstat(void)
+{
+  struct memstat st;
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  kmemstat(&st);
+  tlbstat(&st);
+  return copyout(myproc()->pgdir, (uint)addr, &st, sizeof(st));
+}
+
+// copy the counters of at most n kernel object caches to the user's array
+int
+sys_slabstat(void)
+{
+  int st, n;
+
+  if(argint(0, &st) < 0 || argint(1, &n) < 0 || n < 0)
+    return -1;
+  return slabstat((struct slabstat*)st, n);
+}
+
+// copy the page fault counters of the calling process to the user's struct faultstat
+int
+sys_faultstat(void)
+{
+  struct faultstat st;
+  int addr;
+
+  if(argint(0, &addr) < 0)
+    return -1;
+  faultstat(&st);
+  return copyout(myproc()->pgdir, (uint)addr, &st, sizeof(st));
+}
+
 // Shared memory
 
 extern int shmget(uint, uint, int);
 extern int shmdt(void*);
 extern void * shmat(int, void*, int);
 extern int shmctl(int, int, void*);
+extern int shmcount(void);
+extern int shmatv(struct shmvec*, int);
+extern int shmdtv(struct shmvec*, int);
+extern int futex_wait(void*, int);
+extern int futex_wake(void*, int);
+extern int shminfo(struct shminfo*, int);
 
 // system call handler for shmget
 int
@@ -142,13 +192,226 @@ sys_shmat(void)
 int
 sys_shmctl(void)
 {
-  int shmid, cmd, buf;
+  int shmid, cmd;
+  char *buf;
   // check for valid arguments
   if(argint(0, &shmid) < 0)
     return -1;
   if(argint(1, &cmd) < 0)
     return -1;
-  if(argint(2, &buf) < 0)
+  // IPC_RMID takes no buffer
+  if(cmd != IPC_RMID && argptr(2, &buf, sizeof(struct shmid_ds)) < 0)
+    return -1;
+  return shmctl(shmid, cmd, buf);
+}
+
+// system call handler for shmcount
+int
+sys_shmcount(void)
+{
+  return shmcount();
+}
+
+// system call handler for shmatv
+int
+sys_shmatv(void)
+{
+  struct shmvec *vec;
+  int n;
+  // check for valid arguments, at most one entry per attachable segment
+  if(argint(1, &n) < 0 || n < 0 || n > SHAREDREGIONS)
+    return -1;
+  if(argptr(0, (char**)&vec, n*sizeof(struct shmvec)) < 0)
     return -1;
-  return shmctl(shmid, cmd, (void*)buf);
-}
\ No newline at end of file
+  return shmatv(vec, n);
+}
+
+// system call handler for shmdtv
+int
+sys_shmdtv(void)
+{
+  struct shmvec *vec;
+  int n;
+  // check for valid arguments, at most one entry per attachable segment
+  if(argint(1, &n) < 0 || n < 0 || n > SHAREDREGIONS)
+    return -1;
+  if(argptr(0, (char**)&vec, n*sizeof(struct shmvec)) < 0)
+    return -1;
+  return shmdtv(vec, n);
+}
+
+// system call handler for futex_wait
+int
+sys_futex_wait(void)
+{
+  int addr, expected;
+  // check for valid arguments
+  if(argint(0, &addr) < 0)
+    return -1;
+  if(argint(1, &expected) < 0)
+    return -1;
+  return futex_wait((void*)addr, expected);
+}
+
+// system call handler for futex_wake
+int
+sys_futex_wake(void)
+{
+  int addr, n;
+  // check for valid arguments
+  if(argint(0, &addr) < 0)
+    return -1;
+  if(argint(1, &n) < 0)
+    return -1;
+  return futex_wake((void*)addr, n);
+}
+
+// system call handler for shminfo
+int
+sys_shminfo(void)
+{
+  int info, n;
+  // check for valid arguments, shminfo copies out entry by entry
+  if(argint(0, &info) < 0)
+    return -1;
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  return shminfo((struct shminfo*)info, n);
+}
+
+// Message queues
+
+extern int msgget(uint, int);
+extern int msgsnd(int, struct msgbuf*, uint, int);
+extern int msgrcv(int, struct msgbuf*, uint, int, int);
+extern int msgctl(int, int, struct msqid_ds*);
+extern int msginfo(struct msginfo*, int);
+
+// system call handler for msgget
+int
+sys_msgget(void)
+{
+  int key, msgflag;
+
+  if(argint(0, &key) < 0 || argint(1, &msgflag) < 0)
+    return -1;
+  return msgget((uint)key, msgflag);
+}
+
+// system call handler for msgsnd, the message is mtype and msgsz bytes of text
+int
+sys_msgsnd(void)
+{
+  int msqid, msgsz, msgflag;
+  char *msgp;
+
+  if(argint(0, &msqid) < 0 || argint(2, &msgsz) < 0 || argint(3, &msgflag) < 0)
+    return -1;
+  if(msgsz < 0 || argptr(1, &msgp, sizeof(int) + msgsz) < 0)
+    return -1;
+  return msgsnd(msqid, (struct msgbuf*)msgp, msgsz, msgflag);
+}
+
+// system call handler for msgrcv
+int
+sys_msgrcv(void)
+{
+  int msqid, msgsz, msgtyp, msgflag;
+  char *msgp;
+
+  if(argint(0, &msqid) < 0 || argint(2, &msgsz) < 0 || argint(3, &msgtyp) < 0 || argint(4, &msgflag) < 0)
+    return -1;
+  if(msgsz < 0 || argptr(1, &msgp, sizeof(int) + msgsz) < 0)
+    return -1;
+  return msgrcv(msqid, (struct msgbuf*)msgp, msgsz, msgtyp, msgflag);
+}
+
+// system call handler for msgctl
+int
+sys_msgctl(void)
+{
+  int msqid, cmd;
+  char *buf;
+
+  if(argint(0, &msqid) < 0 || argint(1, &cmd) < 0)
+    return -1;
+  // IPC_RMID takes no buffer
+  if(cmd != IPC_RMID && argptr(2, &buf, sizeof(struct msqid_ds)) < 0)
+    return -1;
+  return msgctl(msqid, cmd, (struct msqid_ds*)buf);
+}
+
+// system call handler for msginfo
+int
+sys_msginfo(void)
+{
+  int info, n;
+  // msginfo copies out entry by entry
+  if(argint(0, &info) < 0)
+    return -1;
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  return msginfo((struct msginfo*)info, n);
+}
+
+// Semaphores
+
+extern int semget(uint, int, int);
+extern int semop(int, struct sembuf*, int);
+extern int semctl(int, int, int, int);
+extern int seminfo(struct seminfo*, int);
+
+// system call handler for semget
+int
+sys_semget(void)
+{
+  int key, nsems, semflag;
+
+  if(argint(0, &key) < 0 || argint(1, &nsems) < 0 || argint(2, &semflag) < 0)
+    return -1;
+  return semget((uint)key, nsems, semflag);
+}
+
+// system call handler for semop
+int
+sys_semop(void)
+{
+  int semid, nsops;
+  char *sops;
+
+  if(argint(0, &semid) < 0 || argint(2, &nsops) < 0)
+    return -1;
+  if(nsops <= 0 || nsops > SEMOPM || argptr(1, &sops, nsops * sizeof(struct sembuf)) < 0)
+    return -1;
+  return semop(semid, (struct sembuf*)sops, nsops);
+}
+
+// system call handler for semctl, the fourth argument is a union semun
+int
+sys_semctl(void)
+{
+  int semid, semnum, cmd, arg = 0;
+  char *buf;
+
+  if(argint(0, &semid) < 0 || argint(1, &semnum) < 0 || argint(2, &cmd) < 0)
+    return -1;
+  // IPC_RMID takes no argument, GETALL / SETALL check the array themselves
+  if(cmd != IPC_RMID && argint(3, &arg) < 0)
+    return -1;
+  if((cmd == IPC_STAT || cmd == IPC_SET) && argptr(3, &buf, sizeof(struct semid_ds)) < 0)
+    return -1;
+  return semctl(semid, semnum, cmd, arg);
+}
+
+// system call handler for seminfo
+int
+sys_seminfo(void)
+{
+  int info, n;
+  // seminfo copies out entry by entry
+  if(argint(0, &info) < 0)
+    return -1;
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  return seminfo((struct seminfo*)info, n);
+}
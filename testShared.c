@@ -1,10 +1,14 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "x86.h"
 #include "mmu.h"
 #include "ipc.h"
 #include "shm.h"
+#include "msg.h"
+#include "sem.h"
 #include "memlayout.h"
+#include "shmring.h"
 
 // test keys
 #define KEY1 2000
@@ -14,6 +18,20 @@
 #define KEY5 4001
 #define KEY6 7778
 #define KEY7 3567
+#define KEY8 5151
+#define KEY9 6262
+#define KEY10 6263
+#define KEY11 6264
+#define KEY12 6265
+#define KEY13 6266
+#define KEY14 6267
+#define KEY15 6268
+#define KEY16 6269
+#define KEY17 6270
+#define KEY18 6271
+#define KEY19 6272
+
+#define LARGESIZE (6*1024*1024) // several MB, well past the old 64 page limit
 
 #define allowedAddr HEAPLIMIT + 3*PGSIZE
 
@@ -24,6 +42,16 @@ void shmctlTest();	// variants of shmctl
 void shmatTest(); // variants of shmat
 void permissionTest();	// tests for permissions on shared memory region
 int forkTest();		// Two forks, parent write, child-1 write, child-2 write, parent read (parent attach)
+int lazyTest();		// SHM_LAZY region, pages become resident on first touch, shared with a child
+int largeTest();	// Create, write, re-attach and read a segment of several MB
+int vectorTest();	// shmatv / shmdtv with one bad entry each, results reported per entry
+int futexTest();	// child waits on a shared word attached at another address, parent wakes it
+int ringTest();		// messages through an spsc ring and an mpmc queue with two senders arrive intact
+int infoTest();		// shminfo reports a region with its attach / detach counters
+int forkAttachTest();	// a child counts as an attacher until it exits, its writes reach the parent
+int resizeTest();	// SHM_RESIZE grows and shrinks a region while children are attached
+int msgTest();		// typed, non-blocking and truncated receives on a message queue, removal wakes a receiver
+int semTest();		// semop applies all of its operations or none, waiters are woken once theirs can complete
 
 int main(int argc, char *argv[]) {
 	/*
@@ -43,6 +71,46 @@ int main(int argc, char *argv[]) {
 	shmctlTest();
 	// tests for of different permissions on regions
 	permissionTest();
+	// lazily allocated region
+	if(lazyTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// region larger than a single page directory leaf
+	if(largeTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// several attaches / detaches in one system call
+	if(vectorTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// wait / wake on a word in a shared region
+	if(futexTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// message rings from the shmring library
+	if(ringTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// region statistics
+	if(infoTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// attach count across fork and exit
+	if(forkAttachTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// growing and shrinking an attached region
+	if(resizeTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// System V message queues
+	if(msgTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	// System V semaphores
+	if(semTest() < 0) {
+		printf(1, "Fail\n");
+	}
 	/* 
 		test for fork,
 		parent (attach) - parent write - child 1 write - child 2 write - parent read and verify - parent detach
@@ -123,9 +191,9 @@ void shmgetTest() {
 	} else {
 		printf(1, "Fail\n");
 	}
-	printf(1, "\t- Requesting region with more than decided pages ( > 64) : ");
+	printf(1, "\t- Requesting region with more than decided pages ( > %d) : ", SHMMAXPAGES);
 	// more than allowed size
-	shmid = shmget(KEY1, 1.6e+7 + 40, 06 | IPC_CREAT);
+	shmid = shmget(KEY1, SHMMAXPAGES*PGSIZE + 40, 06 | IPC_CREAT);
 	if(shmid < 0) {
 		printf(1, "Pass\n");
 	} else {
@@ -385,7 +453,25 @@ void shmatTest() {
 	} else {
         printf(1,"\t\t- Fail\n");
     }
-    nexttest3: printf(1, "\t- Trying to exhaust all regions for the process: ");
+	nexttest3: printf(1, "\t- Trying to map over a segment starting inside the requested range : ");
+	int shmid5 = shmget(KEY10, 2*PGSIZE, 06 | IPC_CREAT);
+	ptr = (char *)shmat(shmid2, (void *)(HEAPLIMIT + PGSIZE), 0);
+	if(shmid5 < 0 || (uint)ptr != HEAPLIMIT + PGSIZE) {
+		printf(1, "Fail\n");
+		shmdt(ptr);
+		goto nexttest4;
+	}
+	// the new segment would cover [HEAPLIMIT, HEAPLIMIT + 2*PGSIZE)
+	ptr2 = (char *)shmat(shmid5, (void *)HEAPLIMIT, 0);
+	if((int)ptr2 < 0) {
+		printf(1, "Cannot Overwrite! : Pass\n");
+	} else {
+		shmdt(ptr2);
+		printf(1, "Fail\n");
+	}
+	shmdt(ptr);
+	shmctl(shmid5, IPC_RMID, (void *)0);
+    nexttest4: printf(1, "\t- Trying to exhaust all regions for the process: ");
 	for(i = 0; ; i++){
 		ptrarr[i] = (char*)shmat(shmid,(void*)0,0);
 		if((int)ptrarr[i] < 0){
@@ -393,7 +479,7 @@ void shmatTest() {
 		}
 	}
 	// should not allow a process to attach more than prescribed regions
-	if(i == SHAREDREGIONS) {
+	if(i == SHAREDREGIONS && shmcount() == SHAREDREGIONS) {
 		printf(1, "Pass\n");
 	} else {
 		printf(1,"Fail\n");
@@ -652,3 +738,501 @@ int forkTest() {
 	}
 	return 0;
 }
+
+// SHM_LAZY region test
+int lazyTest() {
+	printf(1, "* Lazy region (pages allocated on first touch) : ");
+	struct shmid_ds buffer;
+	int shmid = shmget(KEY8, 4*PGSIZE, 06 | IPC_CREAT | SHM_LAZY);
+	if(shmid < 0) {
+		return -1;
+	}
+	// nothing is resident before the first touch
+	if(shmctl(shmid, IPC_STAT, &buffer) < 0 || buffer.shm_rss != 0) {
+		return -1;
+	}
+	char *ptr = (char *)shmat(shmid, (void *)0, 0);
+	if((int)ptr < 0) {
+		return -1;
+	}
+	ptr[0] = 'a';
+	ptr[2*PGSIZE] = 'b';
+	if(shmctl(shmid, IPC_STAT, &buffer) < 0 || buffer.shm_rss != 2) {
+		return -1;
+	}
+	int pid = fork();
+	if(pid < 0) {
+		return -1;
+	} else if(pid == 0) {
+		// child sees parent's pages and touches one more
+		if(ptr[2*PGSIZE] == 'b') {
+			ptr[3*PGSIZE] = 'c';
+		}
+		exit();
+	}
+	wait();
+	if(ptr[3*PGSIZE] != 'c' || shmctl(shmid, IPC_STAT, &buffer) < 0 || buffer.shm_rss != 3) {
+		return -1;
+	}
+	if(shmdt(ptr) < 0 || shmctl(shmid, IPC_RMID, (void *)0) < 0) {
+		return -1;
+	}
+	printf(1, "Pass\n");
+	return 0;
+}
+
+// large segment test
+int largeTest() {
+	printf(1, "* Large segment (%d MB) create, write, read : ", LARGESIZE / (1024*1024));
+	int shmid = shmget(KEY9, LARGESIZE, 06 | IPC_CREAT);
+	if(shmid < 0) {
+		return -1;
+	}
+	int *ptr = (int *)shmat(shmid, (void *)0, 0);
+	if((int)ptr < 0) {
+		return -1;
+	}
+	// tag every page with its number
+	int words = PGSIZE / sizeof(int);
+	for(int i = 0; i < LARGESIZE / PGSIZE; i++) {
+		ptr[i*words] = i;
+		ptr[i*words + words - 1] = ~i;
+	}
+	if(shmdt(ptr) < 0) {
+		return -1;
+	}
+	// read back through a fresh mapping
+	ptr = (int *)shmat(shmid, (void *)0, SHM_RDONLY);
+	if((int)ptr < 0) {
+		return -1;
+	}
+	for(int i = 0; i < LARGESIZE / PGSIZE; i++) {
+		if(ptr[i*words] != i || ptr[i*words + words - 1] != ~i) {
+			return -1;
+		}
+	}
+	if(shmdt(ptr) < 0 || shmctl(shmid, IPC_RMID, (void *)0) < 0) {
+		return -1;
+	}
+	printf(1, "Pass\n");
+	return 0;
+}
+
+int vectorTest() {
+	printf(1, "* Vectored attach and detach, one bad entry each : ");
+	struct shmvec vec[3];
+	int shmid = shmget(KEY11, PGSIZE, 06 | IPC_CREAT);
+	if(shmid < 0) {
+		return -1;
+	}
+	for(int i = 0; i < 3; i++) {
+		vec[i].shmid = shmid;
+		vec[i].shmaddr = (void *)0;
+		vec[i].shmflag = 0;
+	}
+	// no such region
+	vec[1].shmid = SHAREDREGIONS + 1;
+	if(shmatv(vec, 3) != 2 || vec[0].ret != 0 || vec[1].ret != -1 || vec[2].ret != 0) {
+		return -1;
+	}
+	// both good entries are usable and back the same page
+	*(int *)vec[0].shmaddr = 42;
+	if(vec[0].shmaddr == vec[2].shmaddr || *(int *)vec[2].shmaddr != 42) {
+		return -1;
+	}
+	// nothing attached there
+	vec[1].shmaddr = (void *)(KERNBASE - PGSIZE);
+	if(shmdtv(vec, 3) != 2 || vec[0].ret != 0 || vec[1].ret != -1 || vec[2].ret != 0 || shmcount() != 0) {
+		return -1;
+	}
+	if(shmctl(shmid, IPC_RMID, (void *)0) < 0) {
+		return -1;
+	}
+	printf(1, "Pass\n");
+	return 0;
+}
+
+int futexTest() {
+	printf(1, "* Futex wait and wake across processes : ");
+	int shmid = shmget(KEY12, PGSIZE, 06 | IPC_CREAT | SHM_LAZY);
+	if(shmid < 0) {
+		return -1;
+	}
+	int *word = (int *)shmat(shmid, (void *)0, 0);
+	// untouched lazy page reads as 0, a mismatch does not sleep
+	if((int)word < 0 || futex_wait(word, 1) != 1) {
+		return -1;
+	}
+	// not inside a shared region, or not aligned
+	if(futex_wait(&shmid, shmid) != -1 || futex_wake((char *)word + 1, 1) != -1) {
+		return -1;
+	}
+	int pid = fork();
+	if(pid < 0) {
+		return -1;
+	} else if(pid == 0) {
+		// meet the parent through a different virtual address
+		int *other = (int *)shmat(shmid, (void *)(HEAPLIMIT + 8*PGSIZE), 0);
+		if((int)other < 0) {
+			exit();
+		}
+		while(other[0] == 0) {
+			futex_wait(&other[0], 0);
+		}
+		other[1] = other[0] + 1;
+		futex_wake(&other[1], 1);
+		exit();
+	}
+	word[0] = 41;
+	futex_wake(&word[0], 1);
+	while(word[1] == 0) {
+		futex_wait(&word[1], 0);
+	}
+	wait();
+	if(word[1] != 42 || shmdt(word) < 0 || shmctl(shmid, IPC_RMID, (void *)0) < 0) {
+		return -1;
+	}
+	printf(1, "Pass\n");
+	return 0;
+}
+
+#define RINGMSGS 500
+
+int ringTest() {
+	printf(1, "* Ring library, spsc ring and mpmc queue : ");
+	int msg, seen[2] = {0, 0};
+	// small rings, so senders have to wait for the receiver
+	struct spscring *r = spsc_open(KEY13, 4, sizeof(int));
+	struct mpmcqueue *q = mpmc_open(KEY14, 4, sizeof(int));
+	if(r == 0 || q == 0) {
+		return -1;
+	}
+	if(fork() == 0) {
+		for(int i = 0; i < RINGMSGS; i++) {
+			spsc_send(r, &i, sizeof(i));
+		}
+		exit();
+	}
+	// spsc keeps order
+	for(int i = 0; i < RINGMSGS; i++) {
+		if(spsc_recv(r, &msg, sizeof(msg)) != sizeof(msg) || msg != i) {
+			return -1;
+		}
+	}
+	wait();
+	// two senders, tag each message with its sender in bit 30
+	for(int s = 0; s < 2; s++) {
+		if(fork() == 0) {
+			for(int i = 0; i < RINGMSGS; i++) {
+				msg = (s << 30) | i;
+				mpmc_send(q, &msg, sizeof(msg));
+			}
+			exit();
+		}
+	}
+	// order holds per sender
+	for(int i = 0; i < 2*RINGMSGS; i++) {
+		if(mpmc_recv(q, &msg, sizeof(msg)) != sizeof(msg) || (msg & 0xffff) != seen[msg >> 30]++) {
+			return -1;
+		}
+	}
+	wait();
+	wait();
+	if(mpmc_tryrecv(q, &msg, sizeof(msg)) != -1) {
+		return -1;
+	}
+	spsc_close(r);
+	mpmc_close(q);
+	shmctl(shmget(KEY13, 1, 0), IPC_RMID, (void *)0);
+	shmctl(shmget(KEY14, 1, 0), IPC_RMID, (void *)0);
+	printf(1, "Pass\n");
+	return 0;
+}
+
+// index of shmid in info, -1 if shminfo did not report it
+int findInfo(struct shminfo *info, int n, int shmid) {
+	for(int i = 0; i < n; i++) {
+		if(info[i].shmid == shmid) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+int infoTest() {
+	printf(1, "* Region statistics with shminfo : ");
+	struct shminfo info[SHAREDREGIONS];
+	int shmid = shmget(KEY15, 3*PGSIZE, 06 | IPC_CREAT | SHM_LAZY);
+	char *ptr = (char *)shmat(shmid, (void *)0, 0);
+	if(shmid < 0 || (int)ptr < 0) {
+		return -1;
+	}
+	ptr[0] = 1;
+	int n = shminfo(info, SHAREDREGIONS);
+	int i = findInfo(info, n, shmid);
+	if(i < 0 || info[i].key != KEY15 || info[i].size != 3*PGSIZE || info[i].nattch != 1
+		|| info[i].rss != 1 || info[i].attaches != 1 || info[i].faults != 1) {
+		return -1;
+	}
+	// the kernel must not write into a read-only attachment either
+	char *ro = (char *)shmat(shmid, (void *)0, SHM_RDONLY);
+	if((int)ro < 0 || shminfo((struct shminfo *)ro, 1) != -1 || ro[0] != 1 || shmdt(ro) < 0) {
+		return -1;
+	}
+	if(shmdt(ptr) < 0) {
+		return -1;
+	}
+	n = shminfo(info, SHAREDREGIONS);
+	i = findInfo(info, n, shmid);
+	if(i < 0 || info[i].nattch != 0 || info[i].detaches != 2 || shmctl(shmid, IPC_RMID, (void *)0) < 0) {
+		return -1;
+	}
+	// gone once removed
+	n = shminfo(info, SHAREDREGIONS);
+	if(findInfo(info, n, shmid) != -1) {
+		return -1;
+	}
+	printf(1, "Pass\n");
+	return 0;
+}
+
+int forkAttachTest() {
+	printf(1, "* Attach count across fork and exit : ");
+	struct shmid_ds ds;
+	int shmid = shmget(KEY16, 8*PGSIZE, 06 | IPC_CREAT);
+	int *ptr = (int *)shmat(shmid, (void *)0, 0);
+	if(shmid < 0 || (int)ptr < 0) {
+		return -1;
+	}
+	ptr[0] = 0;
+	int pid = fork();
+	if(pid < 0) {
+		return -1;
+	} else if(pid == 0) {
+		// report the count seen while both are attached, through the inherited mapping
+		if(shmctl(shmid, IPC_STAT, &ds) == 0) {
+			ptr[0] = ds.shm_nattch;
+		}
+		exit();
+	}
+	wait();
+	if(ptr[0] != 2 || shmctl(shmid, IPC_STAT, &ds) < 0 || ds.shm_nattch != 1) {
+		return -1;
+	}
+	if(shmdt(ptr) < 0 || shmctl(shmid, IPC_STAT, &ds) < 0 || ds.shm_nattch != 0) {
+		return -1;
+	}
+	shmctl(shmid, IPC_RMID, (void *)0);
+	printf(1, "Pass\n");
+	return 0;
+}
+
+#define RESIZERS 3
+#define WORDS (PGSIZE / sizeof(int))
+
+// sleeps until *word reaches value
+void waitFor(int *word, int value) {
+	int seen;
+	while((seen = *word) < value) {
+		futex_wait(word, seen);
+	}
+}
+
+// adds one to *word and wakes the process waiting for it
+void bump(int *word) {
+	xaddl((uint *)word, 1);
+	futex_wake(word, RESIZERS);
+}
+
+// Words of page 0: [0] children attached, [1] resizes done, [2] children
+// that checked the grown region, [3] children that survived the shrink
+int resizeTest() {
+	printf(1, "* Resize with attached children : ");
+	struct shmid_ds ds;
+	int shmid = shmget(KEY17, PGSIZE, 06 | IPC_CREAT);
+	// far from the segments other tests leave behind, the region grows in place
+	int *ptr = (int *)shmat(shmid, (void *)(HEAPLIMIT + 1024*PGSIZE), 0);
+	if(shmid < 0 || (int)ptr < 0) {
+		return -1;
+	}
+	for(int i = 0; i < 4; i++) {
+		ptr[i] = 0;
+	}
+	for(int i = 0; i < RESIZERS; i++) {
+		int pid = fork();
+		if(pid < 0) {
+			return -1;
+		} else if(pid == 0) {
+			// a second attachment of its own, with room to grow
+			int *mine = (int *)shmat(shmid, (void *)(HEAPLIMIT + (1024 + (i + 1)*64)*PGSIZE), 0);
+			if((int)mine < 0) {
+				exit();
+			}
+			bump(&ptr[0]);
+			waitFor(&ptr[1], 1);
+			// the new pages show up in both attachments
+			for(int k = 2; k < 9; k++) {
+				if(mine[k*WORDS] != k || ptr[k*WORDS] != k) {
+					exit();
+				}
+			}
+			mine[6*WORDS + i + 1] = i + 1;
+			bump(&ptr[2]);
+			waitFor(&ptr[1], 2);
+			// dropped by the shrink, the child is killed here
+			mine[5*WORDS] = 1;
+			bump(&ptr[3]);
+			exit();
+		}
+	}
+	waitFor(&ptr[0], RESIZERS);
+	ds.shm_segsz = 8*PGSIZE;
+	if(shmctl(shmid, SHM_RESIZE, &ds) < 0) {
+		return -1;
+	}
+	for(int k = 2; k < 9; k++) {
+		ptr[k*WORDS] = k;
+	}
+	bump(&ptr[1]);
+	waitFor(&ptr[2], RESIZERS);
+	for(int i = 0; i < RESIZERS; i++) {
+		if(ptr[6*WORDS + i + 1] != i + 1) {
+			return -1;
+		}
+	}
+	ds.shm_segsz = PGSIZE;
+	if(shmctl(shmid, SHM_RESIZE, &ds) < 0) {
+		return -1;
+	}
+	bump(&ptr[1]);
+	for(int i = 0; i < RESIZERS; i++) {
+		wait();
+	}
+	if(ptr[3] != 0 || shmctl(shmid, IPC_STAT, &ds) < 0 || ds.shm_rss != 2 || ds.shm_nattch != 1) {
+		return -1;
+	}
+	// grown again, the pages past the shrink come back zeroed
+	ds.shm_segsz = 4*PGSIZE;
+	if(shmctl(shmid, SHM_RESIZE, &ds) < 0 || ptr[3*WORDS] != 0) {
+		return -1;
+	}
+	if(shmdt(ptr) < 0 || shmctl(shmid, IPC_RMID, (void *)0) < 0) {
+		return -1;
+	}
+	printf(1, "Pass\n");
+	return 0;
+}
+
+int msgTest() {
+	printf(1, "* Message queue send / receive : ");
+	struct {
+		int mtype;
+		char mtext[16];
+	} msg;
+	struct msqid_ds ds;
+	int msqid = msgget(KEY18, RW_MSG | IPC_CREAT | IPC_EXCL);
+	if(msqid < 0 || msgget(KEY18, RW_MSG | IPC_CREAT | IPC_EXCL) != -1 || msgget(KEY18, 0) != msqid) {
+		return -1;
+	}
+	// nothing queued yet
+	if(msgrcv(msqid, &msg, sizeof(msg.mtext), 0, IPC_NOWAIT) != -1) {
+		return -1;
+	}
+	for(int type = 1; type <= 3; type++) {
+		msg.mtype = type;
+		strcpy(msg.mtext, "message 0");
+		msg.mtext[8] = '0' + type;
+		if(msgsnd(msqid, &msg, 10, 0) < 0) {
+			return -1;
+		}
+	}
+	// the first message of type 2, then the lowest type up to 3
+	if(msgrcv(msqid, &msg, sizeof(msg.mtext), 2, 0) != 10 || msg.mtype != 2 || strcmp(msg.mtext, "message 2") != 0) {
+		return -1;
+	}
+	if(msgrcv(msqid, &msg, sizeof(msg.mtext), -3, 0) != 10 || msg.mtype != 1) {
+		return -1;
+	}
+	// too long for the buffer, stays queued unless it may be cut
+	if(msgrcv(msqid, &msg, 4, 0, 0) != -1 || msgrcv(msqid, &msg, 4, 0, MSG_NOERROR) != 4 || msg.mtype != 3) {
+		return -1;
+	}
+	if(msgctl(msqid, IPC_STAT, &ds) < 0 || ds.msg_qnum != 0 || ds.msg_cbytes != 0 || ds.msg_lspid != getpid()) {
+		return -1;
+	}
+	// a receiver blocked on the empty queue fails once it is removed
+	int pid = fork();
+	if(pid == 0) {
+		if(msgrcv(msqid, &msg, sizeof(msg.mtext), 0, 0) != -1) {
+			printf(1, "Fail\n");
+		}
+		exit();
+	}
+	sleep(10);
+	if(msgctl(msqid, IPC_RMID, 0) < 0) {
+		return -1;
+	}
+	wait();
+	if(msgget(KEY18, 0) != -1) {
+		return -1;
+	}
+	printf(1, "Pass\n");
+	return 0;
+}
+
+int semTest() {
+	printf(1, "* Semaphore operations : ");
+	ushort vals[3] = {0, 2, 0};
+	struct sembuf take[2] = {{1, -1, 0}, {0, -1, IPC_NOWAIT}};
+	struct sembuf waitBoth[2] = {{0, -1, 0}, {2, -1, 0}};
+	struct sembuf post = {0, 1, 0};
+	int semid = semget(KEY19, 3, RW_SEM | IPC_CREAT | IPC_EXCL);
+	if(semid < 0 || semget(KEY19, 4, 0) != -1 || semget(KEY19, 0, 0) != semid || semctl(semid, 0, SETALL, vals) < 0) {
+		return -1;
+	}
+	// the second operation would wait, so the first is not applied either
+	if(semop(semid, take, 2) != -1 || semctl(semid, 1, GETVAL) != 2) {
+		return -1;
+	}
+	int pid = fork();
+	if(pid == 0) {
+		// both values are taken in one call once both are there
+		semop(semid, waitBoth, 2);
+		exit();
+	}
+	while(semctl(semid, 0, GETNCNT) != 1) {
+		sleep(1);
+	}
+	// one of the two is not enough
+	if(semop(semid, &post, 1) < 0 || semctl(semid, 0, GETVAL) != 1) {
+		return -1;
+	}
+	if(semctl(semid, 2, SETVAL, 1) < 0) {
+		return -1;
+	}
+	wait();
+	if(semctl(semid, 0, GETALL, vals) < 0 || vals[0] != 0 || vals[1] != 2 || vals[2] != 0
+		|| semctl(semid, 0, GETPID) != pid) {
+		return -1;
+	}
+	// a waiter fails once the set is removed
+	pid = fork();
+	if(pid == 0) {
+		if(semop(semid, waitBoth, 2) != -1) {
+			printf(1, "Fail\n");
+		}
+		exit();
+	}
+	while(semctl(semid, 0, GETNCNT) != 1) {
+		sleep(1);
+	}
+	if(semctl(semid, 0, IPC_RMID) < 0) {
+		return -1;
+	}
+	wait();
+	if(semget(KEY19, 0, 0) != -1) {
+		return -1;
+	}
+	printf(1, "Pass\n");
+	return 0;
+}
@@ -0,0 +1,211 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "x86.h"
+#include "mmu.h"
+#include "ipc.h"
+#include "shm.h"
+#include "shmalloc.h"
+
+// test keys
+#define KEY1 6300
+#define KEY2 6301
+#define KEY3 6302
+#define KEY4 6303
+#define SPACERKEY 6304
+
+#define ARENASIZE (256*1024)
+#define WORKERS 4
+#define BLOCKS 64
+#define ROUNDS 20
+
+int listTest();		// a list built by the parent is walked and extended by a child attached elsewhere
+int reuseTest();	// freed blocks are reused, free large neighbours merge
+int concurrentTest();	// several processes allocate and free at once without overlapping blocks
+int fullTest();		// an exhausted arena returns 0
+
+int main(int argc, char *argv[]) {
+	if(listTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	if(reuseTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	if(concurrentTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	if(fullTest() < 0) {
+		printf(1, "Fail\n");
+	}
+	exit();
+}
+
+// removes the segment behind key, arenas stay around after their users detach
+void removeArena(int key) {
+	int shmid = shmget(key, 1, 0);
+	if(shmid >= 0) {
+		shmctl(shmid, IPC_RMID, (void *)0);
+	}
+}
+
+struct node {
+	uint next;
+	int value;
+};
+
+int listTest() {
+	printf(1, "* List linked by offsets across processes : ");
+	struct shmarena *a = shm_arena_open(KEY1, ARENASIZE);
+	if(a == 0) {
+		return -1;
+	}
+	uint *link = (uint *)shm_root(a);
+	for(int i = 1; i <= 3; i++) {
+		struct node *n = shm_malloc(a, sizeof(*n));
+		if(n == 0) {
+			return -1;
+		}
+		n->value = i;
+		n->next = 0;
+		*link = shm_off(a, n);
+		link = &n->next;
+	}
+	int pid = fork();
+	if(pid == 0) {
+		// attach the arena a second time, at another address
+		struct shmarena *b = shm_arena_open(KEY1, ARENASIZE);
+		if(b == 0 || b == a) {
+			exit();
+		}
+		struct node *n = shm_ptr(b, *shm_root(b));
+		for(int i = 1; i <= 3; i++, n = shm_ptr(b, n->next)) {
+			if(n == 0 || n->value != i) {
+				exit();
+			}
+			if(i == 3) {
+				struct node *last = shm_malloc(b, sizeof(*last));
+				last->value = 4;
+				last->next = 0;
+				n->next = shm_off(b, last);
+			}
+		}
+		exit();
+	}
+	wait();
+	struct node *n = shm_ptr(a, *shm_root(a));
+	for(int i = 1; i <= 4; i++, n = shm_ptr(a, n->next)) {
+		if(n == 0 || n->value != i) {
+			return -1;
+		}
+	}
+	shm_arena_close(a);
+	removeArena(KEY1);
+	printf(1, "Pass\n");
+	return 0;
+}
+
+int reuseTest() {
+	printf(1, "* Reuse of freed blocks : ");
+	struct shmarena *a = shm_arena_open(KEY2, ARENASIZE);
+	if(a == 0) {
+		return -1;
+	}
+	char *small = shm_malloc(a, 40);
+	shm_free(a, small);
+	if(shm_malloc(a, 33) != small) {
+		return -1;
+	}
+	// a freed large block at the top goes back to it
+	char *large = shm_malloc(a, 8000);
+	shm_free(a, large);
+	if(shm_malloc(a, 8000) != large) {
+		return -1;
+	}
+	// two neighbours merge into one block, the small block keeps them off the top
+	char *next = shm_malloc(a, 8000);
+	char *last = shm_malloc(a, 8000);
+	shm_malloc(a, 16);
+	shm_free(a, last);
+	shm_free(a, next);
+	shm_free(a, large);
+	if(shm_malloc(a, 3*8000) != large) {
+		return -1;
+	}
+	shm_arena_close(a);
+	removeArena(KEY2);
+	printf(1, "Pass\n");
+	return 0;
+}
+
+int concurrentTest() {
+	printf(1, "* Concurrent allocation : ");
+	struct shmarena *a = shm_arena_open(KEY3, ARENASIZE);
+	if(a == 0) {
+		return -1;
+	}
+	volatile uint *errors = shm_malloc(a, sizeof(uint));
+	*errors = 0;
+	int spacer = shmget(SPACERKEY, PGSIZE, 06 | IPC_CREAT);
+	for(int w = 0; w < WORKERS; w++) {
+		if(fork() == 0) {
+			// every worker sees the arena at a different address
+			for(int i = 0; i <= w; i++) {
+				shmat(spacer, (void *)0, 0);
+			}
+			struct shmarena *b = shm_arena_open(KEY3, ARENASIZE);
+			volatile uint *errs = shm_ptr(b, shm_off(a, (void *)errors));
+			char *blocks[BLOCKS];
+			int sizes[BLOCKS];
+			for(int r = 0; r < ROUNDS; r++) {
+				for(int i = 0; i < BLOCKS; i++) {
+					sizes[i] = 1 + (i * 37 + r * 11 + w * 101) % (i % 8 == 0 ? 3000 : 200);
+					if((blocks[i] = shm_malloc(b, sizes[i])) == 0) {
+						xaddl(errs, 1);
+						exit();
+					}
+					memset(blocks[i], w + 1, sizes[i]);
+				}
+				for(int i = 0; i < BLOCKS; i++) {
+					for(int j = 0; j < sizes[i]; j++) {
+						if(blocks[i][j] != w + 1) {
+							xaddl(errs, 1);
+							break;
+						}
+					}
+					shm_free(b, blocks[i]);
+				}
+			}
+			exit();
+		}
+	}
+	for(int w = 0; w < WORKERS; w++) {
+		wait();
+	}
+	if(*errors != 0) {
+		return -1;
+	}
+	shm_arena_close(a);
+	removeArena(KEY3);
+	removeArena(SPACERKEY);
+	printf(1, "Pass\n");
+	return 0;
+}
+
+int fullTest() {
+	printf(1, "* Exhausted arena : ");
+	struct shmarena *a = shm_arena_open(KEY4, 4*PGSIZE);
+	if(a == 0 || shm_malloc(a, 0xffffffff) != 0) {
+		return -1;
+	}
+	int n = 0;
+	while(shm_malloc(a, 1000) != 0) {
+		n++;
+	}
+	if(n == 0 || n > 16 || shm_malloc(a, 8000) != 0) {
+		return -1;
+	}
+	shm_arena_close(a);
+	removeArena(KEY4);
+	printf(1, "Pass\n");
+	return 0;
+}
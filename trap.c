@@ -56,6 +56,10 @@ trap(struct trapframe *tf)
     }
     lapiceoi();
     break;
+  case T_TLBFLUSH:
+    tlbflushintr();
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE:
     ideintr();
     lapiceoi();
@@ -78,26 +82,20 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
-  /*
-    Shared memory:
-      handled, while writing into a region with read-only access
-  */
-  case 14:
-    if(strncmp(myproc()->name, "testShared", strlen(myproc()->name)) != 0) {
-      if(myproc() == 0 || (tf->cs&3) == 0){
-        // In kernel, it must be our mistake.
-        cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
-                tf->trapno, cpuid(), tf->eip, rcr2());
-        panic("trap");
-      }
-      // In user space, assume process misbehaved.
-      cprintf("pid %d %s: trap %d err %d on cpu %d "
-              "eip 0x%x addr 0x%x--kill proc\n",
-              myproc()->pid, myproc()->name, tf->trapno,
-              tf->err, cpuid(), tf->eip, rcr2());
-    } else {
-      cprintf("Segmentation fault (Core dumped) - Trap 14\n");
+  case T_PGFLT:
+    // copy-on-write, lazy and shared memory pages, see fault.c
+    if(pagefault(tf) == 0)
+      break;
+    if(myproc() == 0 || (tf->cs&3) == 0){
+      // In kernel, it must be our mistake.
+      cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
+              tf->trapno, cpuid(), tf->eip, rcr2());
+      panic("trap");
     }
+    cprintf("pid %d %s: segmentation fault in %s at addr 0x%x err %d on cpu %d "
+            "eip 0x%x--kill proc\n",
+            myproc()->pid, myproc()->name, faultname(rcr2()), rcr2(),
+            tf->err, cpuid(), tf->eip);
     myproc()->killed = 1;
     break;
 
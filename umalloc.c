@@ -3,30 +3,65 @@
 #include "user.h"
 #include "param.h"
 
-// Memory allocator by Kernighan and Ritchie,
-// The C programming Language, 2nd ed.  Section 8.7.
+// Segregated size-class allocator.
+//
+// Small requests are rounded up to one of the classes below. Each class
+// has a bin of freed blocks and a slab taken from sbrk that new blocks
+// are bump-allocated from, so malloc and free of a small block cost a
+// table lookup and a list push or pop. Requests above the largest class
+// use the first-fit list of Kernighan and Ritchie (The C Programming
+// Language, 2nd ed., section 8.7), which then only holds large blocks.
 
 typedef long Align;
 
+// precedes every block
 union header {
   struct {
-    union header *ptr;
-    uint size;
+    union header *ptr; // next block of a bin or of the large list, while free
+    uint size;         // class of a small block, LARGE | units of a large one
   } s;
   Align x;
 };
 
 typedef union header Header;
 
+#define LARGE 0x80000000
+#define SLABBLOCKS 16 // blocks of the largest classes in a slab, small classes get a page
+// bytes a block of each class can hold, a multiple of sizeof(Header)
+static uint classsize[] = {
+  16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384,
+  448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048,
+};
+#define NCLASS (sizeof(classsize)/sizeof(classsize[0]))
+#define MAXSMALL 2048
+
+static uchar classof[MAXSMALL/16 + 1]; // class for (nbytes+15)/16
+static Header *bins[NCLASS];
+static char *slab[NCLASS], *slabend[NCLASS];
+
 static Header base;
 static Header *freep;
 
-void
-free(void *ap)
+static void
+classinit(void)
 {
-  Header *bp, *p;
+  uint c = 0;
+  int i;
+
+  for(i = 0; i <= MAXSMALL/16; i++){
+    while(classsize[c] < i*16)
+      c++;
+    classof[i] = c;
+  }
+  base.s.ptr = freep = &base;
+  base.s.size = 0;
+}
+
+static void
+freelarge(Header *bp)
+{
+  Header *p;
 
-  bp = (Header*)ap - 1;
   for(p = freep; !(bp > p && bp < p->s.ptr); p = p->s.ptr)
     if(p >= p->s.ptr && (bp > p || bp < p->s.ptr))
       break;
@@ -43,6 +78,25 @@ free(void *ap)
   freep = p;
 }
 
+void
+free(void *ap)
+{
+  Header *bp;
+  uint c;
+
+  if(ap == 0)
+    return;
+  bp = (Header*)ap - 1;
+  if(bp->s.size & LARGE){
+    bp->s.size &= ~LARGE;
+    freelarge(bp);
+    return;
+  }
+  c = bp->s.size;
+  bp->s.ptr = bins[c];
+  bins[c] = bp;
+}
+
 static Header*
 morecore(uint nu)
 {
@@ -56,21 +110,18 @@ morecore(uint nu)
     return 0;
   hp = (Header*)p;
   hp->s.size = nu;
-  free((void*)(hp + 1));
+  freelarge(hp);
   return freep;
 }
 
-void*
-malloc(uint nbytes)
+static void*
+malloclarge(uint nbytes)
 {
   Header *p, *prevp;
   uint nunits;
 
   nunits = (nbytes + sizeof(Header) - 1)/sizeof(Header) + 1;
-  if((prevp = freep) == 0){
-    base.s.ptr = freep = prevp = &base;
-    base.s.size = 0;
-  }
+  prevp = freep;
   for(p = prevp->s.ptr; ; prevp = p, p = p->s.ptr){
     if(p->s.size >= nunits){
       if(p->s.size == nunits)
@@ -81,6 +132,7 @@ malloc(uint nbytes)
         p->s.size = nunits;
       }
       freep = prevp;
+      p->s.size |= LARGE;
       return (void*)(p + 1);
     }
     if(p == freep)
@@ -88,3 +140,34 @@ malloc(uint nbytes)
         return 0;
   }
 }
+
+void*
+malloc(uint nbytes)
+{
+  Header *p;
+  uint c, blocksize, slabsize;
+
+  if(freep == 0)
+    classinit();
+  if(nbytes > MAXSMALL)
+    return malloclarge(nbytes);
+  c = classof[(nbytes + 15)/16];
+  if((p = bins[c]) != 0){
+    bins[c] = p->s.ptr;
+    return (void*)(p + 1);
+  }
+  // bump allocate, the rest of a slab too small for the block is dropped
+  blocksize = sizeof(Header) + classsize[c];
+  if(slabend[c] - slab[c] < blocksize){
+    slabsize = (blocksize*SLABBLOCKS + 4095) & ~4095;
+    if((slab[c] = sbrk(slabsize)) == (char*)-1){
+      slab[c] = slabend[c] = 0;
+      return 0;
+    }
+    slabend[c] = slab[c] + slabsize;
+  }
+  p = (Header*)slab[c];
+  slab[c] += blocksize;
+  p->s.size = c;
+  return (void*)(p + 1);
+}
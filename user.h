@@ -1,5 +1,14 @@
 struct stat;
 struct rtcdate;
+struct shmvec;
+struct shminfo;
+struct memstat;
+struct slabstat;
+struct msqid_ds;
+struct msginfo;
+struct sembuf;
+struct seminfo;
+struct faultstat;
 
 // system calls
 int fork(void);
@@ -29,6 +38,24 @@ int shmget(uint, uint, int);
 int shmat(int, void*, int);
 int shmdt(void*);
 int shmctl(int, int, void*);
+int shmcount(void);
+int shmatv(struct shmvec*, int);
+int shmdtv(struct shmvec*, int);
+int futex_wait(void*, int);
+int futex_wake(void*, int);
+int shminfo(struct shminfo*, int);
+int memstat(struct memstat*);
+int slabstat(struct slabstat*, int);
+int msgget(int, int);
+int msgsnd(int, void*, int, int);
+int msgrcv(int, void*, int, int, int);
+int msgctl(int, int, struct msqid_ds*);
+int msginfo(struct msginfo*, int);
+int semget(int, int, int);
+int semop(int, struct sembuf*, int);
+int semctl(int, int, int, ...);
+int seminfo(struct seminfo*, int);
+int faultstat(struct faultstat*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "fault.h"
 
 char buf[8192];
 char name[3];
@@ -424,6 +425,188 @@ exitwait(void)
   printf(1, "exitwait ok\n");
 }
 
+// fork shares pages copy-on-write: writes by either side,
+// from user space or by the kernel in read(), stay private
+char cowbuf[3*4096];
+
+void
+cowtest(void)
+{
+  int i, pid, fds[2];
+
+  printf(1, "cow test\n");
+  for(i = 0; i < sizeof(cowbuf); i++)
+    cowbuf[i] = 'p';
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < sizeof(cowbuf); i++)
+      if(cowbuf[i] != 'p'){
+        printf(1, "cow: child sees wrong data\n");
+        exit();
+      }
+    cowbuf[0] = 'c';
+    // the kernel writes into the shared page
+    if(read(fds[0], cowbuf + 4096, 10) != 10){
+      printf(1, "cow: read failed\n");
+      exit();
+    }
+    if(cowbuf[4096] != 'x' || cowbuf[8192] != 'p'){
+      printf(1, "cow: child copy wrong\n");
+      exit();
+    }
+    exit();
+  }
+  cowbuf[8192] = 'q';
+  write(fds[1], "xxxxxxxxxx", 10);
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+  if(cowbuf[0] != 'p' || cowbuf[4096] != 'p' || cowbuf[8192] != 'q'){
+    printf(1, "cow: parent sees child's writes\n");
+    exit();
+  }
+  printf(1, "cow ok\n");
+}
+
+// sbrk only reserves the heap, pages come in on first touch,
+// also when the kernel writes them or a child touches them first
+void
+lazysbrktest(void)
+{
+  struct faultstat before, after;
+  char *a, ok;
+  int fds[2], pid;
+
+  printf(1, "lazy sbrk test\n");
+  faultstat(&before);
+  a = sbrk(8*4096);
+  faultstat(&after);
+  if(a == (char*)-1 || after.count[FAULT_HEAP] != before.count[FAULT_HEAP]){
+    printf(1, "lazy sbrk: pages allocated by sbrk\n");
+    exit();
+  }
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  write(fds[1], "lazy", 4);
+  if(read(fds[0], a + 4096, 4) != 4 || a[4096] != 'l' || a[0] != 0){
+    printf(1, "lazy sbrk: kernel write failed\n");
+    exit();
+  }
+  faultstat(&before);
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // reports back only if its faults were served
+    a[7*4096] = 'c';
+    if(a[4096] == 'l' && a[6*4096] == 0)
+      write(fds[1], "y", 1);
+    exit();
+  }
+  close(fds[1]);
+  wait();
+  faultstat(&after);
+  if(read(fds[0], &ok, 1) != 1 || after.fatal != before.fatal){
+    printf(1, "lazy sbrk: child sees wrong data\n");
+    exit();
+  }
+  close(fds[0]);
+  if(a[7*4096] != 0){
+    printf(1, "lazy sbrk: parent sees child's page\n");
+    exit();
+  }
+  sbrk(-8*4096);
+  printf(1, "lazy sbrk ok\n");
+}
+
+// faults are counted by range, one on the stack guard page kills
+void
+faulttest(void)
+{
+  struct faultstat before, after;
+  char *guard;
+  int i, pid;
+
+  printf(1, "fault test\n");
+  faultstat(&before);
+  for(i = 0; i < sizeof(cowbuf); i++)
+    cowbuf[i] = 'p';
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    faultstat(&before);
+    for(i = 0; i < sizeof(cowbuf); i += 4096)
+      cowbuf[i] = 'c';
+    faultstat(&after);
+    // exits without the fatal fault the parent checks for
+    if(after.count[FAULT_HEAP] < before.count[FAULT_HEAP] + 3 || after.fatal != 0){
+      printf(1, "fault: copy-on-write faults not counted\n");
+      exit();
+    }
+    // the page below the stack
+    guard = (char*)(((uint)&guard & ~4095) - 4096);
+    *guard = 'x';
+    exit();
+  }
+  wait();
+  faultstat(&after);
+  if(after.fatal != before.fatal + 1){
+    printf(1, "fault: guard page write not fatal\n");
+    exit();
+  }
+  printf(1, "fault ok\n");
+}
+
+// blocks of every size class and large blocks keep their contents,
+// freed small blocks are reused for the same class
+void
+malloctest(void)
+{
+  char *p[64], *q;
+  int i, j, n;
+
+  printf(1, "malloc test\n");
+  for(i = 0; i < 64; i++){
+    n = i < 48 ? i * 48 : i * 1024;
+    if((p[i] = malloc(n + 1)) == 0){
+      printf(1, "malloc: out of memory\n");
+      exit();
+    }
+    memset(p[i], i, n + 1);
+  }
+  for(i = 0; i < 64; i++){
+    n = i < 48 ? i * 48 : i * 1024;
+    for(j = 0; j <= n; j++)
+      if(p[i][j] != i){
+        printf(1, "malloc: block %d overwritten\n", i);
+        exit();
+      }
+    free(p[i]);
+  }
+  q = malloc(42 * 48 + 1);
+  if(q != p[42]){
+    printf(1, "malloc: freed block not reused\n");
+    exit();
+  }
+  free(q);
+  printf(1, "malloc ok\n");
+}
+
 void
 mem(void)
 {
@@ -1779,7 +1962,11 @@ main(int argc, char *argv[])
   exitiputtest();
   iputtest();
 
+  malloctest();
   mem();
+  cowtest();
+  faulttest();
+  lazysbrktest();
   pipe1();
   preempt();
   exitwait();
@@ -6,9 +6,11 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "traps.h"
+#include "memstat.h"
 
-#include "shm.h"
 #include "ipc.h"
+#include "shm.h"
 #include "spinlock.h"
 
 extern char data[];  // defined by kernel.ld
@@ -43,13 +45,14 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   pte_t *pgtab;
 
   pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    return 0;  // 4MB shared memory page, there is no page table
   if(*pde & PTE_P){
     pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kzalloc()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table
     // entries, if necessary.
@@ -125,9 +128,8 @@ setupkvm(void)
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kzalloc()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
   if (P2V(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
@@ -190,8 +192,7 @@ inituvm(pde_t *pgdir, char *init, uint sz)
 
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pgdir, 0, PGSIZE, V2P(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
@@ -235,13 +236,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pgdir, (char*)a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
       cprintf("allocuvm out of memory (2)\n");
       deallocuvm(pgdir, newsz, oldsz);
@@ -294,7 +294,7 @@ freevm(pde_t *pgdir)
   // deallocuvm(pgdir, KERNBASE, 0);
   deallocuvm(pgdir, HEAPLIMIT, 0);
   for(i = 0; i < NPDENTRIES; i++){
-    if(pgdir[i] & PTE_P){
+    if((pgdir[i] & PTE_P) && !(pgdir[i] & PTE_PS)){
       char * v = P2V(PTE_ADDR(pgdir[i]));
       kfree(v);
     }
@@ -315,40 +315,216 @@ clearpteu(pde_t *pgdir, char *uva)
   *pte &= ~PTE_U;
 }
 
+// Drop stale translations if pgdir is the page table in use.
+static void
+flushtlb(pde_t *pgdir)
+{
+  if(myproc() && myproc()->pgdir == pgdir)
+    lcr3(V2P(pgdir));
+}
+
+// above this many pages one CR3 reload is cheaper than invlpg per page
+#define TLBFLUSHMAX 32
+
+static struct {
+  volatile uint local;   // ranges invalidated by the CPU that changed them
+  volatile uint ipis;    // shootdown interrupts sent to other CPUs
+  volatile uint remote;  // ranges invalidated on behalf of another CPU
+} tlbcount;
+
+// The shootdown in progress. The sender owns it while busy is set and
+// waits until every CPU it interrupted has counted pending down.
+static struct {
+  volatile uint busy;
+  pde_t *pgdir;
+  uint va;
+  uint npages;
+  volatile uint pending;
+} shootdown;
+
+// Invalidate npages pages at va on this CPU, which runs on pgdir.
+static void
+tlbinvalidate(pde_t *pgdir, uint va, uint npages)
+{
+  uint a;
+
+  if(npages > TLBFLUSHMAX){
+    lcr3(V2P(pgdir));
+    return;
+  }
+  for(a = va; a < va + npages*PGSIZE; a += PGSIZE)
+    invlpg((void*)a);
+}
+
+// Drop the translations of npages pages at va in pgdir from every CPU
+// that may cache them: this one with invlpg, every other CPU running
+// pgdir through a T_TLBFLUSH interrupt. The caller must not hold a
+// spinlock, since the CPUs it waits for may be spinning on it.
+void
+tlbflush(pde_t *pgdir, uint va, uint npages)
+{
+  uchar targets[NCPU];
+  struct cpu *c;
+  int i, n;
+
+  pushcli();
+  if(mycpu()->ncli != 1)
+    panic("tlbflush: locks held");
+  if(rcr3() == V2P(pgdir)){
+    tlbinvalidate(pgdir, va, npages);
+    xaddl(&tlbcount.local, 1);
+  }
+  // Order the cleared PTEs before reading cpu->proc. A CPU that switches
+  // to pgdir after this loads CR3 and sees the new entries anyway.
+  __sync_synchronize();
+  for(;;){
+    n = 0;
+    for(c = cpus; c < cpus+ncpu; c++)
+      if(c != mycpu() && c->proc && c->proc->pgdir == pgdir)
+        targets[n++] = c->apicid;
+    if(n == 0){
+      popcli();
+      return;
+    }
+    if(xchg(&shootdown.busy, 1) == 0)
+      break;
+    // Let the shootdown in progress interrupt this CPU while waiting,
+    // also when the caller runs with interrupts off (exit from trap).
+    popcli();
+    if(!(readeflags() & FL_IF))
+      asm volatile("sti; nop; cli");
+    pushcli();
+  }
+  shootdown.pgdir = pgdir;
+  shootdown.va = va;
+  shootdown.npages = npages;
+  shootdown.pending = n;
+  for(i = 0; i < n; i++)
+    lapicipi(targets[i], T_TLBFLUSH);
+  xaddl(&tlbcount.ipis, n);
+  while(shootdown.pending)
+    asm volatile("pause");
+  xchg(&shootdown.busy, 0);
+  popcli();
+}
+
+// T_TLBFLUSH: another CPU changed a page table this one may be running.
+void
+tlbflushintr(void)
+{
+  if(rcr3() == V2P(shootdown.pgdir)){
+    tlbinvalidate(shootdown.pgdir, shootdown.va, shootdown.npages);
+    xaddl(&tlbcount.remote, 1);
+  }
+  xaddl(&shootdown.pending, -1);
+}
+
+void
+tlbstat(struct memstat *st)
+{
+  st->tlblocal = tlbcount.local;
+  st->tlbipis = tlbcount.ipis;
+  st->tlbremote = tlbcount.remote;
+}
+
+// Map a zeroed page at va, a heap page that sbrk reserved and
+// that was not touched since.
+// Returns 0, or -1 if va is mapped already or there is no memory.
+int
+lazyPageFault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem;
+
+  va = PGROUNDDOWN(va);
+  if((pte = walkpgdir(pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P))
+    return -1;
+  if((mem = kzalloc()) == 0){
+    cprintf("lazyPageFault: out of memory\n");
+    return -1;
+  }
+  // not-present entries are never cached by the TLB, no flush needed
+  if(mappages(pgdir, (char*)va, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
 // Given a parent process's page table, create a copy
 // of it for a child.
+// The pages are shared, not copied: writable pages become read-only
+// PTE_COW pages in both tables and are copied by cowPageFault() on the
+// first write. Shared memory above HEAPLIMIT is not part of sz, fork
+// maps it separately so that it stays truly shared.
 pde_t*
 copyuvm(pde_t *pgdir, uint sz)
 {
   pde_t *d;
   pte_t *pte;
   uint pa, i, flags;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+    // heap pages not touched since sbrk stay untouched in the child
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0){
+      i = PGADDR(PDX(i) + 1, 0, 0) - PGSIZE;
+      continue;
+    }
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
+    if(*pte & PTE_W)
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
     flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, flags) < 0)
       goto bad;
-    memmove(mem, (char*)P2V(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, V2P(mem), flags) < 0) {
-      kfree(mem);
-      goto bad;
-    }
+    kref((char*)P2V(pa));
   }
+  // the parent's writable entries just became read-only
+  flushtlb(pgdir);
   return d;
 
 bad:
+  flushtlb(pgdir);
   freevm(d);
   return 0;
 }
 
+// Give pgdir its own writable copy of the copy-on-write page at va,
+// or just make the page writable again if no one else maps it.
+// Returns 0 on success, -1 if va is not a copy-on-write page or
+// there is no memory for the copy.
+int
+cowPageFault(pde_t *pgdir, uint va)
+{
+  pte_t *pte;
+  char *mem, *old;
+
+  if(va >= KERNBASE)
+    return -1;
+  pte = walkpgdir(pgdir, (void*)va, 0);
+  if(pte == 0 || (*pte & (PTE_P|PTE_U|PTE_COW)) != (PTE_P|PTE_U|PTE_COW))
+    return -1;
+  old = (char*)P2V(PTE_ADDR(*pte));
+  if(krefcount(old) == 1){
+    *pte = (*pte | PTE_W) & ~PTE_COW;
+  } else {
+    if((mem = kalloc()) == 0){
+      cprintf("cowPageFault: out of memory\n");
+      return -1;
+    }
+    memmove(mem, old, PGSIZE);
+    *pte = V2P(mem) | ((PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW);
+    kfree(old);
+  }
+  // only the faulting process maps pgdir, no other CPU can cache the entry
+  if(myproc() && myproc()->pgdir == pgdir)
+    invlpg((void*)va);
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -357,7 +533,7 @@ uva2ka(pde_t *pgdir, char *uva)
   pte_t *pte;
 
   pte = walkpgdir(pgdir, uva, 0);
-  if((*pte & PTE_P) == 0)
+  if(pte == 0 || (*pte & PTE_P) == 0)
     return 0;
   if((*pte & PTE_U) == 0)
     return 0;
@@ -366,18 +542,30 @@ uva2ka(pde_t *pgdir, char *uva)
 
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
-// uva2ka ensures this only works for PTE_U pages.
+// uva2ka ensures this only works for PTE_U pages, and only those
+// the user may write are written.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
   uint n, va0;
+  pte_t *pte;
 
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    pte = walkpgdir(pgdir, (char*)va0, 0);
+    // untouched heap of the current process comes in as on a fault
+    if((pte == 0 || !(*pte & PTE_P)) && myproc() && myproc()->pgdir == pgdir && va0 < myproc()->sz){
+      if(lazyPageFault(pgdir, va0) < 0)
+        return -1;
+      pte = walkpgdir(pgdir, (char*)va0, 0);
+    }
+    // writes go through the kernel's mapping, break copy-on-write sharing first
+    if(pte != 0 && (*pte & PTE_COW) && cowPageFault(pgdir, va0) < 0)
+      return -1;
     pa0 = uva2ka(pgdir, (char*)va0);
-    if(pa0 == 0)
+    if(pa0 == 0 || !(*pte & PTE_W))
       return -1;
     n = PGSIZE - (va - va0);
     if(n > len)
@@ -392,23 +580,359 @@ copyout(pde_t *pgdir, uint va, void *p, uint len)
 
 // Shared memory
 
+#define SHMHASHSIZE 31  // buckets for key lookup in shmTable
+#define SHMLEAFSIZE (PGSIZE / sizeof(uint)) // page addresses held by one leaf of a region's page directory
+#define SHMDIRSIZE ((SHMMAXPAGES + SHMLEAFSIZE - 1) / SHMLEAFSIZE) // leaves needed for the largest region
+
 // structure of single shared memory region
 struct shmRegion {
+  // lock for attach count, permissions, page directory and mappings of the region
+  struct spinlock lock;
   uint key, size; // key = region key; size = number of pages, e.g. requested size = 4096 (PGSIZE), then size = 1
   int shmid;  // shmid
   int toBeDeleted;  // flag to check if the region is marked for deletion or not. 1 = marked for deletion, 0 = not marked (default)
-  void *physicalAddr[SHAREDREGIONS];  // store V2P of pages
+  int lazy; // 1 = pages are allocated on first touch (SHM_LAZY), 0 = allocated by shmget (default)
+  int huge; // 1 = backed by 4MB pages (SHM_HUGETLB), size is then a multiple of NPTENTRIES
+  int next; // next region in the same key bucket, or in the free list while unused; -1 ends the chain
+  uint *pageDir[SHMDIRSIZE];  // leaves storing V2P of pages, allocated as the region grows; see walkshmdir()
+  uint attaches, detaches, faults; // counted since the region was created, reported by shminfo()
   struct shmid_ds buffer; // kernel shmid_ds data structure associated with a region
 };
 
 // shared memory table
 struct shmTable {
-  // lock for table
+  // lock for key index, free list and for creating / removing regions,
+  // taken before a region's lock when both are needed
   struct spinlock lock;
   // total shared memory regions
   struct shmRegion allRegions[SHAREDREGIONS];
+  // key -> region index, chained through shmRegion.next
+  int keyIndex[SHMHASHSIZE];
+  // unused regions, chained through shmRegion.next
+  int freeList;
 } shmTable;
 
+/*
+  The attachments of a process (pages, nattached) and its mappings in
+  [HEAPLIMIT, KERNBASE) are changed by the process itself, and cleared
+  by a shrinking SHM_RESIZE from any other process. Both sides hold the
+  process's lock below while doing so; the process reads its own state
+  without it. The locks are shared between processes by pid, and taken
+  after region locks and ptable.lock.
+*/
+static struct spinlock shmProcLock[NPROC];
+#define SHMPROCLOCK(p) (&shmProcLock[(p)->pid % NPROC])
+
+// Return the address of the slot that holds V2P of page pageno of
+// region. If alloc!=0, create the required leaf of the page directory.
+static uint *
+walkshmdir(struct shmRegion *region, uint pageno, int alloc) {
+  uint *leaf;
+
+  if(pageno >= SHMMAXPAGES) {
+    return 0;
+  }
+  leaf = region->pageDir[pageno / SHMLEAFSIZE];
+  if(leaf == 0) {
+    // a zero entry is a page that is not allocated
+    if(!alloc || (leaf = (uint*)kzalloc()) == 0) {
+      return 0;
+    }
+    region->pageDir[pageno / SHMLEAFSIZE] = leaf;
+  }
+  return &leaf[pageno % SHMLEAFSIZE];
+}
+
+// V2P of page pageno of region, 0 if it has no memory yet
+static uint
+shmPageAddr(struct shmRegion *region, uint pageno) {
+  uint *slot = walkshmdir(region, pageno, 0);
+  return slot ? *slot : 0;
+}
+
+/*
+  Page tables of the shared memory range [HEAPLIMIT, KERNBASE) are
+  shared between a parent and its children after fork, counted with
+  kref() like copy-on-write pages. A shared page table is never
+  written: shmUnshareTables() gives the writer its own copy first.
+*/
+
+// Makes the page tables covering npages pages at va private to pgdir.
+// Returns -1 if there is no memory for a copy.
+static int
+shmUnshareTables(pde_t *pgdir, uint va, uint npages) {
+  uint last = va + npages*PGSIZE;
+  for(uint a = va & ~(HUGEPGSIZE-1); a < last; a += HUGEPGSIZE) {
+    pde_t *pde = &pgdir[PDX(a)];
+    if(!(*pde & PTE_P) || (*pde & PTE_PS)) {
+      continue;
+    }
+    char *pgtab = P2V(PTE_ADDR(*pde));
+    if(krefcount(pgtab) == 1) {
+      continue;
+    }
+    char *copy = kalloc();
+    if(copy == 0) {
+      return -1;
+    }
+    memmove(copy, pgtab, PGSIZE);
+    *pde = V2P(copy) | PTE_FLAGS(*pde);
+    // drops this process's reference
+    kfree(pgtab);
+  }
+  return 0;
+}
+
+// Lets go of the page tables covering [va, last) that pgdir still shares,
+// instead of copying them. Entries of other attachments they held are
+// mapped again by shmPageFault() on the next touch.
+static void
+shmDropSharedTables(pde_t *pgdir, uint va, uint last) {
+  for(uint a = va & ~(HUGEPGSIZE-1); a < last; a += HUGEPGSIZE) {
+    pde_t *pde = &pgdir[PDX(a)];
+    if((*pde & PTE_P) && !(*pde & PTE_PS) && krefcount(P2V(PTE_ADDR(*pde))) > 1) {
+      kfree(P2V(PTE_ADDR(*pde)));
+      *pde = 0;
+    }
+  }
+}
+
+// Install a PTE_PS directory entry in pgdir that maps the 4MB page
+// at physical address pa to va.
+static int
+mapHugePage(pde_t *pgdir, uint va, uint pa, int perm)
+{
+  pde_t *pde;
+  pte_t *pgtab;
+
+  pde = &pgdir[PDX(va)];
+  if(*pde & PTE_PS)
+    panic("remap");
+  if(*pde & PTE_P){
+    // page table left behind by 4KB mappings, usable only if they are all gone
+    pgtab = (pte_t*)P2V(PTE_ADDR(*pde));
+    for(int i = 0; i < NPTENTRIES; i++)
+      if(pgtab[i] & PTE_P)
+        return -1;
+    kfree((char*)pgtab);
+  }
+  *pde = pa | perm | PTE_P | PTE_PS;
+  return 0;
+}
+
+// Map the first npages pages of region at va in pgdir. Pages of lazy
+// regions that are not yet touched stay unmapped, huge regions get one
+// directory entry per 4MB instead of a page table.
+static int
+shmMapRegion(pde_t *pgdir, struct shmRegion *region, uint va, uint npages, int perm)
+{
+  if(shmUnshareTables(pgdir, va, npages) < 0) {
+    return -1;
+  }
+  for(uint k = 0; k < npages; k += region->huge ? NPTENTRIES : 1) {
+    uint pa = shmPageAddr(region, k);
+    if(pa == 0) {
+      continue;
+    }
+    if(region->huge) {
+      if(mapHugePage(pgdir, va + k*PGSIZE, pa, perm) < 0) {
+        return -1;
+      }
+    } else if(mappages(pgdir, (void*)(va + k*PGSIZE), PGSIZE, pa, perm) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Clear the entries mapping npages pages at va in pgdir, in place
+static void
+shmClearRange(pde_t *pgdir, uint va, uint npages, int huge)
+{
+  uint a = va, last = va + npages*PGSIZE;
+  while(a < last) {
+    if(huge) {
+      if(pgdir[PDX(a)] & PTE_PS) {
+        pgdir[PDX(a)] = 0;
+      }
+      a += HUGEPGSIZE;
+    } else {
+      pte_t *pte = walkpgdir(pgdir, (void*)a, 0);
+      // untouched pages of lazy regions may not have a page table yet
+      if(pte != 0) {
+        *pte = 0;
+      }
+      a += PGSIZE;
+    }
+  }
+}
+
+// Remove the mappings of npages pages at va from pgdir, the pages
+// themselves belong to the region and are not freed
+static void
+shmUnmapRegion(pde_t *pgdir, uint va, uint npages, int huge)
+{
+  if(!huge && shmUnshareTables(pgdir, va, npages) < 0) {
+    // no memory for a private copy
+    shmDropSharedTables(pgdir, va, va + npages*PGSIZE);
+  }
+  shmClearRange(pgdir, va, npages, huge);
+}
+
+// bucket of keyIndex holding key
+static int
+shmHash(uint key) {
+  return key % SHMHASHSIZE;
+}
+
+// returns index of the region created with key, -1 if there is none.
+// IPC_PRIVATE regions are never indexed. Caller must hold shmTable.lock
+static int
+shmLookup(uint key) {
+  for(int i = shmTable.keyIndex[shmHash(key)]; i != -1; i = shmTable.allRegions[i].next) {
+    if(shmTable.allRegions[i].key == key) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// remove region at index from its key bucket
+static void
+shmUnhash(int index) {
+  int *link = &shmTable.keyIndex[shmHash(shmTable.allRegions[index].key)];
+  while(*link != -1) {
+    if(*link == index) {
+      *link = shmTable.allRegions[index].next;
+      break;
+    }
+    link = &shmTable.allRegions[*link].next;
+  }
+  shmTable.allRegions[index].next = -1;
+}
+
+// reinitialize a region to default (unused) values
+static void
+shmResetRegion(struct shmRegion *region) {
+  region->size = 0;
+  region->key = region->shmid = -1;
+  region->toBeDeleted = 0;
+  region->lazy = 0;
+  region->huge = 0;
+  region->attaches = region->detaches = region->faults = 0;
+  region->buffer.shm_nattch = 0;
+  region->buffer.shm_rss = 0;
+  region->buffer.shm_segsz = 0;
+  region->buffer.shm_perm.__key = -1;
+  region->buffer.shm_perm.mode = 0;
+  region->buffer.shm_cpid = -1;
+  region->buffer.shm_lpid = -1;
+}
+
+// Free the pages recorded in a page directory that was taken out of a
+// region, then the directory leaves themselves. Called without locks.
+static void
+shmFreePages(uint **pageDir, uint size) {
+  for(int i = 0; i < size; i++) {
+    uint *leaf = pageDir[i / SHMLEAFSIZE];
+    // pages of lazy regions that were never touched have no memory
+    if(leaf && leaf[i % SHMLEAFSIZE]) {
+      kfree((char *)P2V(leaf[i % SHMLEAFSIZE]));
+    }
+  }
+  for(int i = 0; i < SHMDIRSIZE; i++) {
+    if(pageDir[i]) {
+      kfree((char *)pageDir[i]);
+    }
+  }
+}
+
+/*
+  Drops region at index from the key index and puts it back on the free
+  list. Its page directory is moved to pageDir and its size returned, so
+  that the caller can shmFreePages() once the locks are released.
+  Caller must hold shmTable.lock, and the region's lock if it was in use
+*/
+static uint
+shmRemoveRegion(int index, uint **pageDir) {
+  struct shmRegion *region = &shmTable.allRegions[index];
+  uint size = region->size;
+  for(int i = 0; i < SHMDIRSIZE; i++) {
+    pageDir[i] = region->pageDir[i];
+    region->pageDir[i] = 0;
+  }
+  if(region->shmid != -1 && region->key != IPC_PRIVATE) {
+    shmUnhash(index);
+  }
+  shmResetRegion(region);
+  region->next = shmTable.freeList;
+  shmTable.freeList = index;
+  return size;
+}
+
+// remove region at index, if it is still marked for deletion and unattached
+static void
+shmDestroy(int index) {
+  struct shmRegion *region = &shmTable.allRegions[index];
+  uint *pageDir[SHMDIRSIZE];
+  uint size = 0;
+  int removed = 0;
+
+  acquire(&shmTable.lock);
+  acquire(&region->lock);
+  if(region->shmid == index && region->toBeDeleted == 1 && region->buffer.shm_nattch == 0) {
+    size = shmRemoveRegion(index, pageDir);
+    removed = 1;
+  }
+  release(&region->lock);
+  release(&shmTable.lock);
+  if(removed) {
+    shmFreePages(pageDir, size);
+  }
+}
+
+// Allocate and zero pages [from, to) of a region that is not visible to
+// other processes yet (or whose lock is held). Huge regions get whole
+// physically contiguous 4MB pages. On failure the pages allocated here
+// are freed again and -1 is returned.
+static int
+shmFillPages(struct shmRegion *region, uint from, uint to, int huge) {
+  uint step = huge ? NPTENTRIES : 1;
+  for(uint i = from; i < to; i += step) {
+    char *newPage = huge ? kalloc_order(HUGEPGORDER) : kzalloc();
+    if(newPage == 0) {
+      cprintf("shmget: failed to allocate a page (out of memory)\n");
+      goto bad;
+    }
+    // zero out, single pages come zeroed from kzalloc()
+    if(huge) {
+      memset(newPage, 0, step*PGSIZE);
+    }
+    for(uint j = 0; j < step; j++) {
+      uint *slot = walkshmdir(region, i + j, 1);
+      if(slot == 0) {
+        // directory leaf allocation failed, give back what is not recorded yet
+        for(uint k = j; k < step; k++) {
+          kfree(newPage + k*PGSIZE);
+        }
+        to = i + j;
+        goto bad;
+      }
+      *slot = V2P(newPage + j*PGSIZE);
+    }
+  }
+  return 0;
+
+bad:
+  for(uint i = from; i < to; i++) {
+    uint *slot = walkshmdir(region, i, 0);
+    if(slot && *slot) {
+      kfree((char *)P2V(*slot));
+      *slot = 0;
+    }
+  }
+  return -1;
+}
 
 /*
   Creates a shared memory region with given key,
@@ -418,9 +942,11 @@ int
 shmget(uint key, uint size, int shmflag) {
   // as Xv6 has only single user, else lower 9 bits would be considered
   int lowerBits = shmflag & 7, permission = -1;
+  // SHM_LAZY and SHM_HUGETLB only matter while creating, strip them before the flag checks
+  int lazy = (shmflag & SHM_LAZY) != 0;
+  int huge = (shmflag & SHM_HUGETLB) != 0;
+  shmflag &= ~(SHM_LAZY | SHM_HUGETLB);
 
-  acquire(&shmTable.lock);
-  
   // separate correct permissions and shmflag
   if(lowerBits == (int)READ_SHM) {
     permission = READ_SHM;
@@ -431,214 +957,251 @@ shmget(uint key, uint size, int shmflag) {
     shmflag ^= RW_SHM;
   } else {
     if(!((shmflag == 0) && (key != IPC_PRIVATE))) {
-      release(&shmTable.lock);
       return -1;
     }
   }
-  // check for requested size
-  if(size <= 0) {
-    release(&shmTable.lock);
+  // check for requested size, -1 marks unused regions so it is never a valid key
+  if(size <= 0 || key == -1) {
     return -1;
   }
   // calculate no of requested pages, from entered size
   int noOfPages = (size / PGSIZE) + 1;
+  // huge regions come in whole 4MB pages, which are allocated up front
+  int noOfHugePages = (noOfPages + NPTENTRIES - 1) / NPTENTRIES * NPTENTRIES;
+  if(huge) {
+    if(lazy) {
+      return -1;
+    }
+    noOfPages = noOfHugePages;
+  }
   // check if no of pages is more than decided limit
-  if(noOfPages > SHAREDREGIONS) {
-    release(&shmTable.lock);
+  if(noOfPages > SHMMAXPAGES) {
     return -1;
   }
   int index = -1;
-  // check if key already exists
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    if(shmTable.allRegions[i].key == key) {
-      // if wrong size is requested with existing region
-      if(shmTable.allRegions[i].size != noOfPages) {
-        release(&shmTable.lock);
-        return -1;
-      }
-      // IPC_CREAT | IPC_EXCL, for region that exists
-      if(shmflag == (IPC_CREAT | IPC_EXCL)) {
-        release(&shmTable.lock);
-        return -1;
+  struct shmRegion *region;
+  uint *pageDir[SHMDIRSIZE];
+
+retry:
+  acquire(&shmTable.lock);
+  // check if key already exists, IPC_PRIVATE always gets a new region
+  if(key != IPC_PRIVATE && (index = shmLookup(key)) != -1) {
+    int shmid = -1;
+    region = &shmTable.allRegions[index];
+    acquire(&region->lock);
+    // get region permissions
+    int checkPerm = region->buffer.shm_perm.mode;
+    // wrong size requested with existing region, or IPC_CREAT | IPC_EXCL for region that exists
+    if(region->size == (region->huge ? noOfHugePages : noOfPages) && shmflag != (IPC_CREAT | IPC_EXCL) &&
+       (checkPerm == READ_SHM || checkPerm == RW_SHM)) {
+      // condition for IPC_PRIVATE, with existing region
+      if((shmflag == 0) && (key != IPC_PRIVATE)) {
+        shmid = region->shmid;
       }
-      // get region permissions
-      int checkPerm = shmTable.allRegions[i].buffer.shm_perm.mode;
-      if(checkPerm == READ_SHM || checkPerm == RW_SHM) {
-        // condition for IPC_PRIVATE, with existing region
-        if((shmflag == 0) && (key != IPC_PRIVATE)) {
-          release(&shmTable.lock);
-          return shmTable.allRegions[i].shmid;
-        }
-        if(shmflag == IPC_CREAT) {
-          release(&shmTable.lock);
-          return shmTable.allRegions[i].shmid;
-        }
+      if(shmflag == IPC_CREAT) {
+        shmid = region->shmid;
       }
-      release(&shmTable.lock);
-      return -1;
     }
+    release(&region->lock);
+    release(&shmTable.lock);
+    return shmid;
   }
-  // check for first valid shared memory region, that can be allocated
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    if(shmTable.allRegions[i].key == -1) {
-      index = i;
-      break;
-    }
+  if(!((key == IPC_PRIVATE) || (shmflag == IPC_CREAT) || (shmflag == (IPC_CREAT | IPC_EXCL)))) {
+    release(&shmTable.lock);
+    return -1;
   }
+  // take first unused region
+  index = shmTable.freeList;
   // memory regions are exhausted
   if(index == -1) {
     release(&shmTable.lock);
     return -1;
   }
-  if((key == IPC_PRIVATE) || (shmflag == IPC_CREAT) || (shmflag == (IPC_CREAT | IPC_EXCL))) {
-    // try to allocate requested size, rounded to page size
-    for(int i = 0; i < noOfPages; i++) {
-      char *newPage = kalloc();
-      if(newPage == 0){
-        cprintf("shmget: failed to allocate a page (out of memory)\n");
-        release(&shmTable.lock);
-        return -1;
-      }
-      // zero out
-      memset(newPage, 0, PGSIZE);
-      shmTable.allRegions[index].physicalAddr[i] = (void *)V2P(newPage);
-    }
-    // mark rest of the fields in structure
-    shmTable.allRegions[index].size = noOfPages;
-    shmTable.allRegions[index].key = key;
-
-    // store data for shmid_ds data structure
-    shmTable.allRegions[index].buffer.shm_segsz = size;
-    shmTable.allRegions[index].buffer.shm_perm.__key = key;
-    shmTable.allRegions[index].buffer.shm_perm.mode = permission;
-
-    // store creator pid
-    shmTable.allRegions[index].buffer.shm_cpid = myproc()->pid;
-    
-    // store shmid in not yet shared region
-    shmTable.allRegions[index].shmid = index;
+  region = &shmTable.allRegions[index];
+  shmTable.freeList = region->next;
+  region->next = -1;
+  release(&shmTable.lock);
 
+  // the region is off the free list and has no shmid yet, so no other
+  // process can reach it while its pages are allocated without locks.
+  // lazy regions get their pages in shmPageFault(), on first touch
+  if(!lazy && shmFillPages(region, 0, noOfPages, huge) < 0) {
+    acquire(&shmTable.lock);
+    shmRemoveRegion(index, pageDir);
     release(&shmTable.lock);
-    return index; // valid shmid
-  } else {
-    release(&shmTable.lock);
+    shmFreePages(pageDir, 0);
     return -1;
-  }  
-}
+  }
 
-// finds the least starting address of a segment greater than curr_va which is attached 
-// to the virtual address space of the current process. Returns the index from the pages  
-// array corresponding to this address if found; -1 otherwise
-int 
-getLeastvaidx(void* curr_va, struct proc *process) {
+  acquire(&shmTable.lock);
+  // another process may have created the same key in the meantime
+  if(key != IPC_PRIVATE && shmLookup(key) != -1) {
+    region->size = lazy ? 0 : noOfPages;
+    uint filled = shmRemoveRegion(index, pageDir);
+    release(&shmTable.lock);
+    shmFreePages(pageDir, filled);
+    goto retry;
+  }
+  acquire(&region->lock);
+  // mark rest of the fields in structure
+  region->size = noOfPages;
+  region->key = key;
+  region->lazy = lazy;
+  region->huge = huge;
+
+  // store data for shmid_ds data structure
+  region->buffer.shm_segsz = size;
+  region->buffer.shm_perm.__key = key;
+  region->buffer.shm_perm.mode = permission;
+  region->buffer.shm_rss = lazy ? 0 : noOfPages;
+
+  // store creator pid
+  region->buffer.shm_cpid = myproc()->pid;
   
-  //maximum virtual address available in range
-  void* leastva = (void*)(KERNBASE - 1);
+  // store shmid in not yet shared region
+  region->shmid = index;
+  release(&region->lock);
+
+  // make region reachable by key
+  if(key != IPC_PRIVATE) {
+    int bucket = shmHash(key);
+    region->next = shmTable.keyIndex[bucket];
+    shmTable.keyIndex[bucket] = index;
+  }
+
+  release(&shmTable.lock);
+  return index; // valid shmid
+}
+
+/*
+  A process keeps its attachments in pages[0..nattached), sorted by
+  address. Segments never overlap, so their end addresses are sorted as
+  well and an address can be located with a binary search.
+*/
+
+// index of the first attachment ending above va, nattached if there is none
+static int
+shmFindAttach(struct proc *process, uint va) {
+  int low = 0, high = process->nattached;
+  while(low < high) {
+    int mid = (low + high) / 2;
+    if((uint)process->pages[mid].virtualAddr + process->pages[mid].size*PGSIZE > va) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return low;
+}
 
-  int idx = -1;
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    if(process->pages[i].key != -1 && (uint)process->pages[i].virtualAddr >= (uint)curr_va && (uint)leastva >= (uint)process->pages[i].virtualAddr) {  
-      // store address if greater than curr_va and smaller than the existing least_va.
-      leastva = process->pages[i].virtualAddr;
+// inserts an attachment at index idx, shifting the later ones up
+static void
+shmInsertAttach(struct proc *process, int idx, int shmid, struct shmRegion *region, void *va, int perm) {
+  memmove(&process->pages[idx + 1], &process->pages[idx], (process->nattached - idx) * sizeof(sharedPages));
+  process->pages[idx].shmid = shmid;
+  process->pages[idx].virtualAddr = va;
+  process->pages[idx].key = region->key;
+  process->pages[idx].size = region->size;
+  process->pages[idx].perm = perm;
+  process->nattached += 1;
+}
+
+// removes the attachment at index idx, shifting the later ones down
+static void
+shmRemoveAttach(struct proc *process, int idx) {
+  process->nattached -= 1;
+  memmove(&process->pages[idx], &process->pages[idx + 1], (process->nattached - idx) * sizeof(sharedPages));
+  process->pages[process->nattached].shmid = -1;
+  process->pages[process->nattached].key = -1;
+  process->pages[process->nattached].size = 0;
+  process->pages[process->nattached].virtualAddr = (void*)0;
+}
 
-      idx = i;
+// first address from HEAPLIMIT where npages fit between the attachments
+// of the process, huge regions can only start on a 4MB boundary
+static uint
+shmFindHole(struct proc *process, uint npages, int huge) {
+  uint va = HEAPLIMIT;
+  for(int i = 0; i < process->nattached; i++) {
+    uint start = (uint)process->pages[i].virtualAddr;
+    if((huge ? HUGEPGROUNDUP(va) : va) + npages*PGSIZE <= start) {
+      break;
     }
-  }  
-  return idx;
+    va = start + process->pages[i].size*PGSIZE;
+  }
+  return huge ? HUGEPGROUNDUP(va) : va;
 }
 
 // detaches the shared memory segment starting at shmaddr from virtual address space of the process
 // returns 0 if successful and -1 in case of a failure
 int 
 shmdt(void* shmaddr) {
-  acquire(&shmTable.lock);
   struct proc *process = myproc();
-  void* va = (void*)0;
+  int index, shmid, destroy;
   uint size;
-  int index,shmid;
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    // find the index from pages array which is attached at the provided shmaddr
-    if(process->pages[i].key != -1 && process->pages[i].virtualAddr == shmaddr) {
-        va =  process->pages[i].virtualAddr;
-        index = i;
-        shmid = process->pages[i].shmid;
-        size = process->pages[index].size;
-        break;
-    }
-  }
-  if(va) {
-    for(int i = 0; i < size; i++) {
-      pte_t* pte = walkpgdir(process->pgdir, (void*)((uint)va + i*PGSIZE), 0);
-      if(pte == 0) {
-        release(&shmTable.lock);
-        return -1;
-      }
-		  *pte = 0;
-    }
-    process->pages[index].shmid = -1;  
-    process->pages[index].key = -1;
-    process->pages[index].size =  0;
-    process->pages[index].virtualAddr = (void*)0;
-    if(shmTable.allRegions[shmid].buffer.shm_nattch > 0) {
-      // decrement attaches
-      shmTable.allRegions[shmid].buffer.shm_nattch -= 1;
-    } 
-    if(shmTable.allRegions[shmid].buffer.shm_nattch == 0 && shmTable.allRegions[shmid].toBeDeleted == 1) {
-      // remove the segments
-      for(int i = 0; i < shmTable.allRegions[index].size; i++) {
-        char *addr = (char *)P2V(shmTable.allRegions[index].physicalAddr[i]);
-        kfree(addr);
-        shmTable.allRegions[index].physicalAddr[i] = (void *)0;
-      }
-      shmTable.allRegions[index].size = 0;
-      shmTable.allRegions[index].key = shmTable.allRegions[index].shmid = -1;
-      shmTable.allRegions[index].toBeDeleted = 0;
-      shmTable.allRegions[index].buffer.shm_nattch = 0;
-      shmTable.allRegions[index].buffer.shm_segsz = 0;
-      shmTable.allRegions[index].buffer.shm_perm.__key = -1;
-      shmTable.allRegions[index].buffer.shm_perm.mode = 0;
-      shmTable.allRegions[index].buffer.shm_cpid = -1;
-      shmTable.allRegions[index].buffer.shm_lpid = -1;
-    }
-    shmTable.allRegions[shmid].buffer.shm_lpid = process->pid;
-    release(&shmTable.lock);
-    return 0;
-  } else {
-    release(&shmTable.lock);
+  // find the attachment starting at the provided shmaddr
+  index = shmFindAttach(process, (uint)shmaddr);
+  if(index == process->nattached || process->pages[index].virtualAddr != shmaddr) {
     return -1;
   }
-  
+  shmid = process->pages[index].shmid;
+  size = process->pages[index].size;
+  struct shmRegion *region = &shmTable.allRegions[shmid];
+  acquire(&region->lock);
+  acquire(SHMPROCLOCK(process));
+  shmUnmapRegion(process->pgdir, (uint)shmaddr, size, region->huge);
+  shmRemoveAttach(process, index);
+  release(SHMPROCLOCK(process));
+  region->detaches += 1;
+  if(region->buffer.shm_nattch > 0) {
+    // decrement attaches
+    region->buffer.shm_nattch -= 1;
+  } 
+  region->buffer.shm_lpid = process->pid;
+  destroy = region->buffer.shm_nattch == 0 && region->toBeDeleted == 1;
+  release(&region->lock);
+  // before the pages can be freed with the region
+  tlbflush(process->pgdir, (uint)shmaddr, size);
+  if(destroy) {
+    // remove the segments, needs shmTable.lock which is taken before the region's lock
+    shmDestroy(shmid);
+  }
+  return 0;
 }
 
 // attaches shared memory segment identified by shmid to the virtual address shmaddr 
 // if provided; otherwise attach at the first fitting address 
 void*
 shmat(int shmid, void* shmaddr, int shmflag) {
-  if(shmid < 0 || shmid > 64) {
+  if(shmid < 0 || shmid >= SHAREDREGIONS) {
     return (void*)-1;
   }
-  acquire(&shmTable.lock);
-  int index = -1,idx, permflag;
-  uint segment,size = 0;
-  void *va = (void*)HEAPLIMIT, *least_va;
+  struct shmRegion *region = &shmTable.allRegions[shmid];
+  acquire(&region->lock);
+  int idx, permflag;
+  void *va = (void*)HEAPLIMIT;
   struct proc *process = myproc();
-  index = shmTable.allRegions[shmid].shmid;
-  if(index == -1) {
+  if(region->shmid == -1) {
     // shmid not found
-    release(&shmTable.lock);
+    release(&region->lock);
     return (void*)-1;
   }
+  if(process->nattached == SHAREDREGIONS) {
+    release(&region->lock);
+    return (void*)-1; // all page regions exhausted
+  }
   if(shmaddr) {
     if((uint)shmaddr >= KERNBASE || (uint)shmaddr < HEAPLIMIT) {
-      release(&shmTable.lock);
+      release(&region->lock);
       return (void*)-1;
     }
-    // round down to nearest multiple of SHMLBA
-    uint rounded = ((uint)shmaddr & ~(SHMLBA-1));  
+    // round down to nearest multiple of SHMLBA, or of the page size for huge regions
+    uint lba = region->huge ? HUGEPGSIZE : SHMLBA;
+    uint rounded = ((uint)shmaddr & ~(lba-1));  
 
     if(shmflag & SHM_RND) {
       if(!rounded) {
-        release(&shmTable.lock);
+        release(&region->lock);
         return (void*)-1;
       }
       va = (void*)rounded;
@@ -651,90 +1214,172 @@ shmat(int shmid, void* shmaddr, int shmflag) {
     }
       
   } else {    
-    for(int i = 0; i < SHAREDREGIONS; i++) {
-      idx = getLeastvaidx(va,process);
-      if(idx != -1) {
-        least_va = process->pages[idx].virtualAddr;
-        if((uint)va + shmTable.allRegions[index].size*PGSIZE <=  (uint)least_va)        
-          break;
-        else
-          va = (void*)((uint)least_va + process->pages[idx].size*PGSIZE);
-      } else 
-        break;
-    }
+    va = (void*)shmFindHole(process, region->size, region->huge);
   }
-  if((uint)va + shmTable.allRegions[index].size*PGSIZE >= KERNBASE) {
+  if((uint)va + region->size*PGSIZE >= KERNBASE) {
     // size exceeded
-    release(&shmTable.lock);
+    release(&region->lock);
     return (void*)-1;
   }
-  idx = -1;
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    if(process->pages[i].key != -1 && (uint)process->pages[i].virtualAddr + process->pages[i].size*PGSIZE > (uint)va && (uint)va >= (uint)process->pages[i].virtualAddr)  {
-      idx = i;
-      break;
+  // first attachment ending above va, it conflicts if it starts before the new segment ends
+  idx = shmFindAttach(process, (uint)va);
+  while(idx < process->nattached && (uint)process->pages[idx].virtualAddr < (uint)va + region->size*PGSIZE) {
+    if(!(shmflag & SHM_REMAP)) {
+      release(&region->lock);
+      return (void*)-1;
     }
-  }
-  if(idx != -1) {
-    if(shmflag & SHM_REMAP) {
-      segment = (uint)process->pages[idx].virtualAddr;
-      // repeat till all conflicting mappings are removed
-      while(segment < (uint)va + shmTable.allRegions[index].size*PGSIZE) { 
-        size = process->pages[idx].size;
-        release(&shmTable.lock);
-        if(shmdt((void*)segment) == -1) {
-          return (void*)-1;
-        }
-        acquire(&shmTable.lock);        
-        idx = getLeastvaidx((void*)(segment + size*PGSIZE),process);
-        if(idx == -1)
-          break;
-        segment = (uint)process->pages[idx].virtualAddr;
-      }
-    } else {
-      release(&shmTable.lock);
+    // repeat till all conflicting mappings are removed
+    release(&region->lock);
+    if(shmdt(process->pages[idx].virtualAddr) == -1) {
+      return (void*)-1;
+    }
+    acquire(&region->lock);
+    // the detach may have removed this very region
+    if(region->shmid != shmid) {
+      release(&region->lock);
       return (void*)-1;
     }
-
   }
-  if((shmflag & SHM_RDONLY) || (shmTable.allRegions[index].buffer.shm_perm.mode == READ_SHM)){
+  if((shmflag & SHM_RDONLY) || (region->buffer.shm_perm.mode == READ_SHM)){
     permflag = PTE_U;
   }
-  else if (shmTable.allRegions[index].buffer.shm_perm.mode == RW_SHM) {
+  else if (region->buffer.shm_perm.mode == RW_SHM) {
     permflag = PTE_W | PTE_U;
   } else {
     //permission mismatch between get and attach
-    release(&shmTable.lock);
+    release(&region->lock);
     return (void*)-1;
   }
-  for (int k = 0; k < shmTable.allRegions[index].size; k++) {
-		if(mappages(process->pgdir, (void*)((uint)va + (k*PGSIZE)), PGSIZE, (uint)shmTable.allRegions[index].physicalAddr[k], permflag) < 0) {
-      deallocuvm(process->pgdir,(uint)va,(uint)(va + shmTable.allRegions[index].size));
-      release(&shmTable.lock);
-      return (void*)-1;
+  // pages of lazy regions not yet touched stay unmapped, shmPageFault() maps them
+  acquire(SHMPROCLOCK(process));
+  if(shmMapRegion(process->pgdir, region, (uint)va, region->size, permflag) < 0) {
+    uint npages = region->size;
+    shmUnmapRegion(process->pgdir, (uint)va, npages, region->huge);
+    release(SHMPROCLOCK(process));
+    release(&region->lock);
+    tlbflush(process->pgdir, (uint)va, npages);
+    return (void*)-1;
+  }
+  shmInsertAttach(process, idx, shmid, region, va, permflag);
+  release(SHMPROCLOCK(process));
+  region->attaches += 1;
+  region->buffer.shm_nattch += 1;
+  region->buffer.shm_lpid = process->pid;
+  release(&region->lock);
+  return va;
+}
+
+// attachers of a region being shrunk by SHM_RESIZE
+struct shmShrink {
+  int shmid;
+  uint from, to;          // pages [from, to) are dropped
+  int huge;
+  pde_t *flush[NPROC];    // page tables to flush once the region is unlocked
+  int nflush;
+};
+
+// Clears the mappings of the dropped pages from every attachment of p.
+// A page table still shared after fork is cleared in place: the sharers
+// map the same attachments through it, so they all lose the pages.
+static void
+shmUnmapShrunk(struct proc *p, void *arg) {
+  struct shmShrink *shrink = arg;
+  int found = 0;
+
+  acquire(SHMPROCLOCK(p));
+  for(int i = 0; i < p->nattached; i++) {
+    uint size = p->pages[i].size;
+    if(p->pages[i].shmid != shrink->shmid || size <= shrink->from) {
+      continue;
     }
-	}
-  idx = -1;
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    if(process->pages[i].key == -1) {
-      idx = i;
-      break;
+    if(size > shrink->to) {
+      size = shrink->to;
     }
+    shmClearRange(p->pgdir, (uint)p->pages[i].virtualAddr + shrink->from*PGSIZE, size - shrink->from, shrink->huge);
+    found = 1;
   }
-  if(idx != -1) {
-    process->pages[idx].shmid = shmid;  
-    process->pages[idx].virtualAddr = va;
-    process->pages[idx].key = shmTable.allRegions[index].key;
-    process->pages[idx].size = shmTable.allRegions[index].size;
-    process->pages[idx].perm = permflag;
-    shmTable.allRegions[index].buffer.shm_nattch += 1;
-    shmTable.allRegions[index].buffer.shm_lpid = process->pid;
-  } else {
-    release(&shmTable.lock);
-    return (void*)-1; // all page regions exhausted
+  if(found) {
+    shrink->flush[shrink->nflush++] = p->pgdir;
   }
-  release(&shmTable.lock);
-  return va;
+  release(SHMPROCLOCK(p));
+}
+
+/*
+  SHM_RESIZE: sets the size of region to bytes, without moving the pages
+  it keeps. Growing allocates the new pages (lazy regions get them on
+  first touch), attachers map them through shmPageFault() when they
+  touch past their old end. Shrinking unmaps the dropped pages from all
+  attachers at once and frees them. Called with the region's lock held,
+  which is released.
+*/
+static int
+shmResize(struct shmRegion *region, uint bytes) {
+  struct shmShrink shrink;
+  uint *cut[SHMDIRSIZE];
+  uint size = bytes / PGSIZE + 1, oldsize = region->size;
+
+  if(region->huge) {
+    size = (size + NPTENTRIES - 1) / NPTENTRIES * NPTENTRIES;
+  }
+  if(bytes == 0 || size > SHMMAXPAGES) {
+    release(&region->lock);
+    return -1;
+  }
+  if(size >= oldsize) {
+    if(!region->lazy) {
+      if(shmFillPages(region, oldsize, size, region->huge) < 0) {
+        release(&region->lock);
+        return -1;
+      }
+      region->buffer.shm_rss += size - oldsize;
+    }
+    region->size = size;
+    region->buffer.shm_segsz = bytes;
+    release(&region->lock);
+    return 0;
+  }
+
+  // move the dropped pages to cut, laid out like the region's directory
+  memset(cut, 0, sizeof(cut));
+  uint keep = (size + SHMLEAFSIZE - 1) / SHMLEAFSIZE;
+  if(size % SHMLEAFSIZE && region->pageDir[size / SHMLEAFSIZE]) {
+    uint *leaf = region->pageDir[size / SHMLEAFSIZE];
+    if((cut[size / SHMLEAFSIZE] = (uint*)kzalloc()) == 0) {
+      release(&region->lock);
+      return -1;
+    }
+    for(uint i = size % SHMLEAFSIZE; i < SHMLEAFSIZE; i++) {
+      cut[size / SHMLEAFSIZE][i] = leaf[i];
+      leaf[i] = 0;
+    }
+  }
+  for(uint i = keep; i < SHMDIRSIZE; i++) {
+    cut[i] = region->pageDir[i];
+    region->pageDir[i] = 0;
+  }
+  for(uint i = size; i < oldsize; i++) {
+    if(cut[i / SHMLEAFSIZE] && cut[i / SHMLEAFSIZE][i % SHMLEAFSIZE]) {
+      region->buffer.shm_rss -= 1;
+    }
+  }
+  region->size = size;
+  region->buffer.shm_segsz = bytes;
+
+  // no attacher can map the dropped pages again, take them out of all
+  shrink.shmid = region->shmid;
+  shrink.from = size;
+  shrink.to = oldsize;
+  shrink.huge = region->huge;
+  shrink.nflush = 0;
+  procforeach(shmUnmapShrunk, &shrink);
+  release(&region->lock);
+
+  // stale translations must be gone before the pages are reused
+  for(int i = 0; i < shrink.nflush; i++) {
+    tlbflush(shrink.flush[i], HEAPLIMIT, (KERNBASE - HEAPLIMIT) / PGSIZE);
+  }
+  shmFreePages(cut, oldsize);
+  return 0;
 }
 
 /*
@@ -745,37 +1390,51 @@ shmat(int shmid, void* shmaddr, int shmflag) {
 int
 shmctl(int shmid, int cmd, void *buf) {
   // check shmid bound
-  if(shmid < 0 || shmid > 64){
+  if(shmid < 0 || shmid >= SHAREDREGIONS){
     return -1;
   }
 
-  acquire(&shmTable.lock);
-
+  struct shmRegion *region = &shmTable.allRegions[shmid];
   struct shmid_ds *buffer = (struct shmid_ds *)buf;
+  struct shmid_ds ds;
+  uint *pageDir[SHMDIRSIZE];
+  uint size;
+
+  // the user buffer is only touched with the region unlocked, a fault
+  // on it may land in shmPageFault() which takes the region's lock
+  if(cmd == IPC_SET || cmd == SHM_RESIZE) {
+    if(buffer == 0) {
+      return -1;
+    }
+    ds = *buffer;
+  }
+  // removal changes the free list and key index as well
+  if(cmd == IPC_RMID) {
+    acquire(&shmTable.lock);
+  }
+  acquire(&region->lock);
 
   int index = -1;
-  index = shmTable.allRegions[shmid].shmid;
+  index = region->shmid;
   // check for valid shmid
   if(index == -1) {
-    release(&shmTable.lock);
+    release(&region->lock);
+    if(cmd == IPC_RMID) {
+      release(&shmTable.lock);
+    }
     return -1;
   } else {
     // get permissions on region with provided shmid
-    int checkPerm = shmTable.allRegions[index].buffer.shm_perm.mode;
+    int checkPerm = region->buffer.shm_perm.mode;
     switch(cmd) {
       // handle IPC_SET flag, to set values from user data structure to kernel data structure
       case IPC_SET:
-        if(buffer) {
-          if((buffer->shm_perm.mode == READ_SHM) || (buffer->shm_perm.mode == RW_SHM)) {
-            shmTable.allRegions[index].buffer.shm_perm.mode = buffer->shm_perm.mode;
-            release(&shmTable.lock);
-            return 0;
-          } else {
-            release(&shmTable.lock);
-            return -1;
-          }
+        if((ds.shm_perm.mode == READ_SHM) || (ds.shm_perm.mode == RW_SHM)) {
+          region->buffer.shm_perm.mode = ds.shm_perm.mode;
+          release(&region->lock);
+          return 0;
         } else {
-          release(&shmTable.lock);
+          release(&region->lock);
           return -1;
         }
         break;
@@ -787,47 +1446,39 @@ shmctl(int shmid, int cmd, void *buf) {
       case IPC_STAT:
         // check valid permissions
         if(buffer && (checkPerm == READ_SHM || checkPerm == RW_SHM)) {
-          buffer->shm_nattch = shmTable.allRegions[index].buffer.shm_nattch;
-          buffer->shm_segsz = shmTable.allRegions[index].buffer.shm_segsz;
-          buffer->shm_perm.__key = shmTable.allRegions[index].buffer.shm_perm.__key;
-          buffer->shm_perm.mode = checkPerm;
-          buffer->shm_cpid = shmTable.allRegions[index].buffer.shm_cpid;
-          buffer->shm_lpid = shmTable.allRegions[index].buffer.shm_lpid;
-          release(&shmTable.lock);
-          return 0;
+          ds = region->buffer;
+          release(&region->lock);
+          return copyout(myproc()->pgdir, (uint)buffer, &ds, sizeof(ds));
         } else {
-          release(&shmTable.lock);
+          release(&region->lock);
           return -1;
         }
         break;
       // handle IPC_RMID flag, to remove shared memory region associated with give shmid
       case IPC_RMID:
-        if(shmTable.allRegions[index].buffer.shm_nattch == 0) {
-          for(int i = 0; i < shmTable.allRegions[index].size; i++) {
-            char *addr = (char *)P2V(shmTable.allRegions[index].physicalAddr[i]);
-            kfree(addr);
-            shmTable.allRegions[index].physicalAddr[i] = (void *)0;
-          }
-          // reinitialize other values to default values
-          shmTable.allRegions[index].size = 0;
-          shmTable.allRegions[index].key = shmTable.allRegions[index].shmid = -1;
-          shmTable.allRegions[index].toBeDeleted = 0;
-          shmTable.allRegions[index].buffer.shm_nattch = 0;
-          shmTable.allRegions[index].buffer.shm_segsz = 0;
-          shmTable.allRegions[index].buffer.shm_perm.__key = -1;
-          shmTable.allRegions[index].buffer.shm_perm.mode = 0;
-          shmTable.allRegions[index].buffer.shm_cpid = -1;
-          shmTable.allRegions[index].buffer.shm_lpid = -1;
+        if(region->buffer.shm_nattch == 0) {
+          size = shmRemoveRegion(index, pageDir);
+          release(&region->lock);
+          release(&shmTable.lock);
+          shmFreePages(pageDir, size);
         } else {
           // mark the segment to be destroyed
-          shmTable.allRegions[index].toBeDeleted = 1;
+          region->toBeDeleted = 1;
+          release(&region->lock);
+          release(&shmTable.lock);
         }
-        release(&shmTable.lock);
         return 0;
         break;
+      // handle SHM_RESIZE, to grow or shrink the region in place
+      case SHM_RESIZE:
+        if(checkPerm != RW_SHM) {
+          release(&region->lock);
+          return -1;
+        }
+        return shmResize(region, ds.shm_segsz);
       // handle other cases
       default:
-        release(&shmTable.lock);
+        release(&region->lock);
         return -1;
         break;
     }
@@ -839,47 +1490,313 @@ void
 sharedMemoryInit(void) {
   // initialize shmtable lock
   initlock(&shmTable.lock, "Shared Memory");
+  for(int i = 0; i < NPROC; i++) {
+    initlock(&shmProcLock[i], "Shared Memory process");
+  }
   acquire(&shmTable.lock);
   // initialize all shmtable values
-  for(int i = 0; i < SHAREDREGIONS; i++) {
-    shmTable.allRegions[i].key = shmTable.allRegions[i].shmid = -1;
-    shmTable.allRegions[i].size = 0;
-    shmTable.allRegions[i].toBeDeleted = 0;
-    shmTable.allRegions[i].buffer.shm_nattch = 0;
-    shmTable.allRegions[i].buffer.shm_segsz = 0;
-    shmTable.allRegions[i].buffer.shm_perm.__key = -1;
-    shmTable.allRegions[i].buffer.shm_perm.mode = 0;
-    shmTable.allRegions[i].buffer.shm_cpid = -1;
-    shmTable.allRegions[i].buffer.shm_lpid = -1;
-    for(int j = 0; j < SHAREDREGIONS; j++) {
-      shmTable.allRegions[i].physicalAddr[j] = (void *)0;
+  for(int i = 0; i < SHMHASHSIZE; i++) {
+    shmTable.keyIndex[i] = -1;
+  }
+  shmTable.freeList = -1;
+  // push in reverse, so that lower shmids are handed out first
+  for(int i = SHAREDREGIONS - 1; i >= 0; i--) {
+    initlock(&shmTable.allRegions[i].lock, "Shared Memory region");
+    shmResetRegion(&shmTable.allRegions[i]);
+    for(int j = 0; j < SHMDIRSIZE; j++) {
+      shmTable.allRegions[i].pageDir[j] = 0;
     }
+    shmTable.allRegions[i].next = shmTable.freeList;
+    shmTable.freeList = i;
   }
   release(&shmTable.lock);
 }
 
-// to return shmid index from shmtable
+// gives child the attachments of parent at the same addresses, called by fork.
+// The child shares the parent's page tables instead of mapping every page again
+void
+shmFork(struct proc *parent, struct proc *child) {
+  struct spinlock *first = SHMPROCLOCK(parent), *second = SHMPROCLOCK(child);
+  for(int i = 0; i < parent->nattached; i++) {
+    struct shmRegion *region = &shmTable.allRegions[parent->pages[i].shmid];
+    acquire(&region->lock);
+    region->buffer.shm_nattch += 1;
+    region->attaches += 1;
+    release(&region->lock);
+  }
+  // both locks, so that a shrink sees the parent's mappings and the
+  // child's attachments either before or after the copy. In array order,
+  // as two forks may hold them at once
+  if(first > second) {
+    first = SHMPROCLOCK(child);
+    second = SHMPROCLOCK(parent);
+  }
+  acquire(first);
+  if(second != first) {
+    acquire(second);
+  }
+  for(uint a = HEAPLIMIT; a < KERNBASE; a += HUGEPGSIZE) {
+    pde_t pde = parent->pgdir[PDX(a)];
+    if(!(pde & PTE_P)) {
+      continue;
+    }
+    // 4MB pages have no page table, the entry itself is copied
+    if(!(pde & PTE_PS)) {
+      kref(P2V(PTE_ADDR(pde)));
+    }
+    child->pgdir[PDX(a)] = pde;
+  }
+  for(int i = 0; i < parent->nattached; i++) {
+    child->pages[i] = parent->pages[i];
+  }
+  child->nattached = parent->nattached;
+  if(second != first) {
+    release(second);
+  }
+  release(first);
+}
+
+// detaches every segment of the current process, called by exit and exec
+void
+shmDetachAll(void) {
+  struct proc *process = myproc();
+  // page tables still shared with a relative are just let go, not copied and cleared
+  acquire(SHMPROCLOCK(process));
+  shmDropSharedTables(process->pgdir, HEAPLIMIT, KERNBASE);
+  release(SHMPROCLOCK(process));
+  lcr3(V2P(process->pgdir));
+  while(process->nattached > 0) {
+    shmdt(process->pages[process->nattached - 1].virtualAddr);
+  }
+}
+
+/*
+  Handles a page fault at va inside an attached region of the current
+  process. The first touch of a lazy region's page allocates and zeroes
+  it, every later fault (from any attacher) maps that same page. A fault
+  just past an attachment whose region has grown (SHM_RESIZE) extends
+  the attachment to the new size, if that runs into no other attachment.
+  Returns 0 if the fault was handled, -1 if it is a real access violation
+*/
 int
-getShmidIndex(int shmid) {
-  if(shmid < 0 || shmid > 64) {
+shmPageFault(uint va, uint err) {
+  struct proc *process = myproc();
+  int idx;
+
+  va = PGROUNDDOWN(va);
+  // protection violations are never resolved here
+  if(err & FEC_PR) {
     return -1;
   }
-  return shmTable.allRegions[shmid].shmid;
+  idx = shmFindAttach(process, va);
+  if(idx == process->nattached || (uint)process->pages[idx].virtualAddr > va) {
+    // not inside an attachment, maybe past the end of the one below
+    if(idx == 0) {
+      return -1;
+    }
+    idx--;
+  }
+  if((err & FEC_WR) && !(process->pages[idx].perm & PTE_W)) {
+    return -1;
+  }
+  struct shmRegion *region = &shmTable.allRegions[process->pages[idx].shmid];
+  uint start = (uint)process->pages[idx].virtualAddr;
+  uint page = (va - start) / PGSIZE;
+  int perm = process->pages[idx].perm;
+  acquire(&region->lock);
+  if(region->shmid == -1 || page >= region->size) {
+    release(&region->lock);
+    return -1;
+  }
+  acquire(SHMPROCLOCK(process));
+  if(page >= process->pages[idx].size) {
+    uint end = start + region->size*PGSIZE;
+    if(end >= KERNBASE || (idx + 1 < process->nattached && end > (uint)process->pages[idx + 1].virtualAddr)) {
+      goto bad;
+    }
+    process->pages[idx].size = region->size;
+  }
+  if(region->huge) {
+    // only the part added by a resize is not mapped by shmat already
+    uint first = page & ~(NPTENTRIES-1);
+    uint pa = shmPageAddr(region, first);
+    if(pa == 0 || mapHugePage(process->pgdir, start + first*PGSIZE, pa, perm) < 0) {
+      goto bad;
+    }
+  } else {
+    uint *slot = walkshmdir(region, page, 1);
+    if(slot != 0 && *slot == 0) {
+      char *newPage = kzalloc();
+      if(newPage == 0) {
+        cprintf("shmPageFault: failed to allocate a page (out of memory)\n");
+        goto bad;
+      }
+      *slot = V2P(newPage);
+      region->buffer.shm_rss += 1;
+    }
+    if(slot == 0 || shmUnshareTables(process->pgdir, va, 1) < 0 || mappages(process->pgdir, (void*)va, PGSIZE, *slot, perm) < 0) {
+      goto bad;
+    }
+  }
+  region->faults += 1;
+  release(SHMPROCLOCK(process));
+  release(&region->lock);
+  return 0;
+
+bad:
+  release(SHMPROCLOCK(process));
+  release(&region->lock);
+  return -1;
+}
+
+// attaches every segment of vec as shmat would, in a single system call.
+// Each entry reports its own result, returns the number of successful attaches
+int
+shmatv(struct shmvec *vec, int n) {
+  int attached = 0;
+  for(int i = 0; i < n; i++) {
+    void *va = shmat(vec[i].shmid, vec[i].shmaddr, vec[i].shmflag);
+    if((int)va == -1) {
+      vec[i].ret = -1;
+    } else {
+      vec[i].shmaddr = va;
+      vec[i].ret = 0;
+      attached++;
+    }
+  }
+  return attached;
 }
 
-void mappagesWrapper(struct proc *process, int shmIndex, int index) {
-  for(int i = 0; i < process->pages[index].size; i++) {
-    uint va = (uint)process->pages[index].virtualAddr;
-    if(mappages(process->pgdir, (void*)(va + (i * PGSIZE)), PGSIZE, (uint)shmTable.allRegions[shmIndex].physicalAddr[i], process->pages[index].perm) < 0) {
-      deallocuvm(process->pgdir, va, (uint)(va + shmTable.allRegions[shmIndex].size));
-      return;
+// detaches every segment of vec as shmdt would, in a single system call.
+// Each entry reports its own result, returns the number of successful detaches
+int
+shmdtv(struct shmvec *vec, int n) {
+  int detached = 0;
+  for(int i = 0; i < n; i++) {
+    vec[i].ret = shmdt(vec[i].shmaddr);
+    if(vec[i].ret == 0) {
+      detached++;
+    }
+  }
+  return detached;
+}
+
+// copies the state of at most n live regions to the user array info,
+// returns the number of regions copied or -1 if info is not writable
+int
+shminfo(struct shminfo *info, int n) {
+  struct shminfo entry;
+  int count = 0;
+  for(int i = 0; i < SHAREDREGIONS && count < n; i++) {
+    struct shmRegion *region = &shmTable.allRegions[i];
+    acquire(&region->lock);
+    if(region->shmid == -1) {
+      release(&region->lock);
+      continue;
+    }
+    entry.shmid = region->shmid;
+    entry.key = region->key;
+    entry.size = region->buffer.shm_segsz;
+    entry.mode = region->buffer.shm_perm.mode;
+    entry.nattch = region->buffer.shm_nattch;
+    entry.cpid = region->buffer.shm_cpid;
+    entry.lpid = region->buffer.shm_lpid;
+    entry.toBeDeleted = region->toBeDeleted;
+    entry.rss = region->buffer.shm_rss;
+    entry.attaches = region->attaches;
+    entry.detaches = region->detaches;
+    entry.faults = region->faults;
+    release(&region->lock);
+    // copyout checks that the user's array is mapped
+    if(copyout(myproc()->pgdir, (uint)&info[count], &entry, sizeof(entry)) < 0) {
+      return -1;
+    }
+    count++;
+  }
+  return count;
+}
+
+// number of segments attached to the current process
+int
+shmcount(void) {
+  return myproc()->nattached;
+}
+
+/*
+  Futexes. A waiter sleeps on the kernel address of the shared word
+  itself, so every process that maps the same (region, page, offset)
+  meets on the same channel whatever its own attach address is. The
+  region's lock makes checking the word and going to sleep atomic
+  with respect to futex_wake.
+*/
+
+// locks the region behind the user address va of the current process and
+// returns it, with the kernel address of the word at va in *kva.
+// Returns 0 if va is not inside an attached segment
+static struct shmRegion*
+shmLockAddr(uint va, int **kva) {
+  struct proc *process = myproc();
+  int idx = shmFindAttach(process, va);
+  pde_t *pde = &process->pgdir[PDX(va)];
+  pte_t *pte;
+
+  if(idx == process->nattached || (uint)process->pages[idx].virtualAddr > va) {
+    return 0;
+  }
+  // untouched page of a lazy region, bring it in like a read fault would
+  if(!(*pde & PTE_PS) && ((pte = walkpgdir(process->pgdir, (void*)va, 0)) == 0 || !(*pte & PTE_P))) {
+    if(shmPageFault(va, 0) < 0) {
+      return 0;
     }
   }
+  struct shmRegion *region = &shmTable.allRegions[process->pages[idx].shmid];
+  uint offset = va - (uint)process->pages[idx].virtualAddr;
+  acquire(&region->lock);
+  uint pa = shmPageAddr(region, offset / PGSIZE);
+  if(region->shmid == -1 || pa == 0) {
+    release(&region->lock);
+    return 0;
+  }
+  *kva = (int*)((char*)P2V(pa) + offset % PGSIZE);
+  return region;
 }
 
-void shmdtWrapper(void *addr) {
-  // call shmdt
-  shmdt(addr);
+// sleeps until futex_wake on addr, provided the word at addr still holds expected.
+// Returns 0 after a wake up, 1 if the word did not match and -1 for a bad address
+int
+futex_wait(void *addr, int expected) {
+  int *kva;
+  if((uint)addr % sizeof(int)) {
+    return -1;
+  }
+  struct shmRegion *region = shmLockAddr((uint)addr, &kva);
+  if(region == 0) {
+    return -1;
+  }
+  if(*kva != expected) {
+    release(&region->lock);
+    return 1;
+  }
+  sleep(kva, &region->lock);
+  release(&region->lock);
+  return 0;
+}
+
+// wakes at most n processes waiting on addr.
+// Returns the number woken, -1 for a bad address
+int
+futex_wake(void *addr, int n) {
+  int *kva;
+  if((uint)addr % sizeof(int)) {
+    return -1;
+  }
+  struct shmRegion *region = shmLockAddr((uint)addr, &kva);
+  if(region == 0) {
+    return -1;
+  }
+  int woken = wakeupn(kva, n);
+  release(&region->lock);
+  return woken;
 }
 
 //PAGEBREAK!
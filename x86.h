@@ -130,6 +130,42 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Atomically replace *addr with newval if it holds expected.
+// Returns the value *addr held before. Also a compiler barrier,
+// other memory accesses are not moved across it.
+static inline uint
+cmpxchg(volatile uint *addr, uint expected, uint newval)
+{
+  uint result;
+
+  asm volatile("lock; cmpxchgl %2, %1" :
+               "=a" (result), "+m" (*addr) :
+               "r" (newval), "0" (expected) :
+               "cc", "memory");
+  return result;
+}
+
+// Atomically add val to *addr, returns the value *addr held before.
+// A compiler barrier like cmpxchg.
+static inline uint
+xaddl(volatile uint *addr, uint val)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (val), "+m" (*addr) :
+               :
+               "cc", "memory");
+  return val;
+}
+
+// Read the low 32 bits of the time-stamp counter.
+static inline uint
+rdtsc(void)
+{
+  uint lo;
+  asm volatile("rdtsc" : "=a" (lo) : : "edx");
+  return lo;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -144,6 +180,21 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+static inline uint
+rcr3(void)
+{
+  uint val;
+  asm volatile("movl %%cr3,%0" : "=r" (val));
+  return val;
+}
+
+// Drop this CPU's TLB entry for the page holding addr.
+static inline void
+invlpg(void *addr)
+{
+  asm volatile("invlpg (%0)" : : "r" (addr) : "memory");
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().